@@ -0,0 +1,313 @@
+#include <cmath>
+#include <algorithm>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <SoapySDR/Errors.hpp>
+#include <SoapySDR/Types.hpp>
+#include <SoapySDR/Formats.hpp>
+#include "acquisition.h"
+#include "metrics.h"
+
+void AcquisitionStats::report(std::ostream& out) const
+{
+    out << "Samples received: " << samplesReceived << std::endl;
+    out << "Short reads: " << shortReads << ", timeouts: " << timeouts
+        << ", overflows: " << overflows << ", stream errors: " << streamErrors << std::endl;
+    out << "Ring overruns: " << ringOverruns << " blocks dropped" << std::endl;
+    out << "Discontinuities: " << discontinuities << ", dropped samples: " << droppedSamples << std::endl;
+}
+
+void AcquisitionStats::add(const AcquisitionStats& other)
+{
+    samplesReceived += other.samplesReceived;
+    shortReads += other.shortReads;
+    timeouts += other.timeouts;
+    overflows += other.overflows;
+    streamErrors += other.streamErrors;
+    ringOverruns += other.ringOverruns;
+    discontinuities += other.discontinuities;
+    droppedSamples += other.droppedSamples;
+}
+
+void SampleSource::tune(double)
+{
+    throw std::runtime_error{"This source cannot be tuned"};
+}
+
+void readBlock(SoapySDR::Device* device, SoapySDR::Stream* stream, RxBlock& block, AcquisitionStats& stats)
+{
+    const size_t lenght = block.samples.size();
+    size_t filled = 0;
+    int consecutiveTimeouts = 0;
+    block.flags = 0;
+    block.timeNs = 0;
+
+    while(filled < lenght)
+    {
+        void* buffs[] = {block.samples.data() + filled};
+        int flags = 0;
+        long long time_ns = 0;
+        int ret = device->readStream(stream, buffs, lenght - filled, flags, time_ns, readTimeoutUs);
+
+        if(ret > 0)
+        {
+            /*only the first fragment's time stamp marks the start of the block*/
+            if(filled == 0 && (flags & SOAPY_SDR_HAS_TIME))
+            {
+                block.timeNs = time_ns;
+                block.flags |= blockHasTime;
+            }
+            if(static_cast<size_t>(ret) < lenght - filled)
+            {
+                stats.shortReads++;
+                METRICS_ADD(Counter::shortReads, 1);
+            }
+            filled += ret;
+            stats.samplesReceived += ret;
+            consecutiveTimeouts = 0;
+        }
+        else if(ret == SOAPY_SDR_TIMEOUT || ret == 0)
+        {
+            stats.timeouts++;
+            METRICS_ADD(Counter::timeouts, 1);
+            if(++consecutiveTimeouts >= maxConsecutiveTimeouts)
+            {
+                throw std::runtime_error{"Device stopped delivering samples"};
+            }
+        }
+        else if(ret == SOAPY_SDR_OVERFLOW)
+        {
+            /*samples were lost inside the device, the gap shows up in the time stamps*/
+            stats.overflows++;
+            METRICS_ADD(Counter::overflows, 1);
+            block.flags |= blockAfterOverflow;
+        }
+        else
+        {
+            stats.streamErrors++;
+            METRICS_ADD(Counter::streamErrors, 1);
+            throw std::runtime_error{std::string{"readStream failed: "} + SoapySDR::errToStr(ret)};
+        }
+    }
+}
+
+/*a device lists what it supports as ranges, throws when `value` is in none of them*/
+static void checkRanges(const SoapySDR::RangeList& ranges, double value, const std::string& what)
+{
+    if(ranges.empty())
+    {
+        return;
+    }
+    std::ostringstream supported;
+    for(size_t i = 0; i < ranges.size(); ++i)
+    {
+        if(value >= ranges[i].minimum() && value <= ranges[i].maximum())
+        {
+            return;
+        }
+        supported << (i > 0 ? ", " : "") << ranges[i].minimum() << "->" << ranges[i].maximum();
+    }
+    throw std::runtime_error{what + " " + std::to_string(static_cast<long long>(value)) +
+                             " is not supported by the device: " + supported.str()};
+}
+
+/*open the device, print what it offers and apply the settings*/
+SoapySource::SoapySource(double freq, double sampleRate, int gain, int bandwidth, const std::string& serial)
+    : centerFreq(freq), rate(sampleRate)
+{
+    /*get all sdr devices*/
+    SoapySDR::KwargsList results = SoapySDR::Device::enumerate();
+    SoapySDR::Kwargs::iterator itr;
+
+    /*show the results*/
+    if(results.empty())
+    {
+        throw std::runtime_error{"No devices connected"};
+    }
+
+    for( int i = 0; i < results.size(); ++i)
+    {
+        std::cout << "Found device #" << i << " ";
+        for( itr = results[i].begin(); itr != results[i].end(); ++itr)
+        {
+            std::cout << itr->first.c_str() << " = " << itr->second.c_str() <<std::endl;
+        }
+        std::cout << std::endl;
+    }
+    size_t found = 0;
+    while(!serial.empty() && found < results.size() &&
+          !(results[found].count("serial") && results[found]["serial"] == serial))
+    {
+        found++;
+    }
+    if(found == results.size())
+    {
+        throw std::runtime_error{"No device with serial number " + serial};
+    }
+
+    /*get only one device*/
+    SoapySDR::Kwargs arg = results[found];
+    device = SoapySDR::Device::make(arg);
+    if(device == nullptr || device == NULL)
+    {
+        throw std::runtime_error{"Cannot make a device"};
+    }
+
+    /*query device info*/
+    std::vector<std::string> str_list;
+
+    /*antennas*/
+    str_list = device->listAntennas(SOAPY_SDR_RX, channel);
+    std::cout << "RX antennas: ";
+    for(int i = 0; i < str_list.size(); ++i)
+    {
+        std::cout << str_list[i].c_str() << ", ";
+    }
+    std::cout << std::endl;
+
+    /*gains*/
+    str_list = device->listGains(SOAPY_SDR_RX, channel);
+    std::cout << "RX gains: ";
+    for(int i = 0; i < str_list.size(); ++i)
+    {
+        std::cout << str_list[i].c_str() << ", ";
+    }
+    std::cout << std::endl;
+
+    /*frequency ranges*/
+    freqRanges = device->getFrequencyRange(SOAPY_SDR_RX, channel);
+    std::cout << "RX ranges: ";
+    for(int i = 0; i < freqRanges.size(); ++i)
+    {
+        std::cout << freqRanges[i].minimum() << "->" << freqRanges[i].maximum();
+    }
+    std::cout << std::endl;
+
+    /*the driver would round or clamp a value it does not support without a word*/
+    try
+    {
+        checkRanges(freqRanges, freq, "Frequency");
+        checkRanges(device->getSampleRateRange(SOAPY_SDR_RX, channel), sampleRate, "Sample rate");
+        checkRanges({device->getGainRange(SOAPY_SDR_RX, channel)}, gain, "Gain");
+    }
+    catch(const std::exception&)
+    {
+        SoapySDR::Device::unmake(device);
+        throw;
+    }
+
+    /*set the settings*/
+    device->setSampleRate(SOAPY_SDR_RX, channel, sampleRate);
+    device->setFrequency(SOAPY_SDR_RX, channel, freq);
+    device->setGain(SOAPY_SDR_RX, channel, gain);
+    device->setBandwidth(SOAPY_SDR_RX, channel, bandwidth);
+
+    /*setup a stream*/
+    stream = device->setupStream(SOAPY_SDR_RX, SOAPY_SDR_CS8);
+    if(stream == NULL || stream == nullptr)
+    {
+        SoapySDR::Device::unmake(device);
+        throw std::runtime_error{"Cannot create a stream"};
+    }
+    device->activateStream(stream, 0, 0, 0);
+}
+
+SoapySource::~SoapySource()
+{
+    device->deactivateStream(stream, 0, 0);
+    device->closeStream(stream);
+
+    SoapySDR::Device::unmake(device);
+}
+
+bool SoapySource::read(RxBlock& block, AcquisitionStats& stats)
+{
+    readBlock(device, stream, block, stats);
+    return true;
+}
+
+void SoapySource::tune(double freq)
+{
+    checkRanges(freqRanges, freq, "Frequency");
+    device->setFrequency(SOAPY_SDR_RX, channel, freq);
+    centerFreq = freq;
+    /*samples queued in the driver were taken at the old frequency*/
+    flush();
+}
+
+void SoapySource::flush()
+{
+    /*restarting the stream drops what the driver queued*/
+    device->deactivateStream(stream, 0, 0);
+    device->activateStream(stream, 0, 0, 0);
+}
+
+void receiveBlocks(SampleSource& source, SpscRing<RxBlock>& ring,
+                   int blockLenght, long long numberOfBlocks, const std::atomic<bool>& stop,
+                   AcquisitionStats& stats, size_t& highWaterMark)
+{
+    RxBlock scratch;
+    scratch.samples.resize(blockLenght);
+    bool dropped = false;
+    METRICS_SET(Gauge::ringCapacity, ring.capacity());
+    for(long long i = 0; (numberOfBlocks < 0 || i < numberOfBlocks) && !stop; ++i)
+    {
+        RxBlock* slot = ring.acquire();
+        {
+            METRICS_TIME(Stage::read);
+            if(!source.read(slot != nullptr ? *slot : scratch, stats))
+            {
+                break;
+            }
+        }
+        METRICS_ADD(Counter::samplesReceived, blockLenght);
+        if(slot == nullptr)
+        {
+            stats.ringOverruns++;
+            METRICS_ADD(Counter::ringOverruns, 1);
+            dropped = true;
+            continue;
+        }
+        if(dropped)
+        {
+            slot->flags |= blockAfterDrop;
+            dropped = false;
+        }
+        const size_t occupancy = ring.publish();
+        highWaterMark = std::max(highWaterMark, occupancy);
+        METRICS_SET(Gauge::ringOccupancy, occupancy);
+        METRICS_RAISE(Gauge::ringHighWater, occupancy);
+    }
+}
+
+ContinuityChecker::ContinuityChecker(double sampleRate, int blockLenght)
+    : sampleRate(sampleRate), blockNs(blockLenght * 1e9 / sampleRate)
+{
+}
+
+void ContinuityChecker::check(const RxBlock& block, AcquisitionStats& stats)
+{
+    if(!(block.flags & blockHasTime))
+    {
+        haveLast = false;
+        return;
+    }
+    if(haveLast)
+    {
+        /*more than half a sample away from where the previous block ended*/
+        const double gapNs = block.timeNs - (lastTimeNs + blockNs);
+        if(std::fabs(gapNs) * sampleRate > 0.5e9)
+        {
+            stats.discontinuities++;
+            METRICS_ADD(Counter::discontinuities, 1);
+            if(gapNs > 0)
+            {
+                stats.droppedSamples += std::llround(gapNs * sampleRate / 1e9);
+                METRICS_ADD(Counter::droppedSamples, std::llround(gapNs * sampleRate / 1e9));
+            }
+        }
+    }
+    lastTimeNs = block.timeNs;
+    haveLast = true;
+}
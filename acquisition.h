@@ -0,0 +1,112 @@
+#ifndef _ACQUISITION_H
+#define _ACQUISITION_H
+
+#include <atomic>
+#include <vector>
+#include <complex>
+#include <string>
+#include <cstdint>
+#include <ostream>
+#include <SoapySDR/Device.hpp>
+#include "ringbuffer.h"
+#include "rxblock.h"
+
+/*SDR channel*/
+constexpr int channel = 0;
+
+/*readStream timeout, microseconds*/
+constexpr long readTimeoutUs = 1000000;
+/*give up when the device delivers nothing for this many timeouts in a row*/
+constexpr int maxConsecutiveTimeouts = 10;
+
+/*everything that can go wrong between the device and the disk, counted*/
+struct AcquisitionStats
+{
+    long long samplesReceived = 0;
+    long long shortReads = 0;
+    long long timeouts = 0;
+    long long overflows = 0;
+    long long streamErrors = 0;
+    long long ringOverruns = 0;     //blocks read but dropped because the ring was full
+    long long discontinuities = 0;  //saved blocks whose time stamp does not follow the previous one
+    long long droppedSamples = 0;   //estimated from the time stamp gaps
+
+    void report(std::ostream& out) const;
+    /*sum of the counts of several receivers*/
+    void add(const AcquisitionStats& other);
+};
+
+/*
+where the RX thread gets its blocks from. read() fills a slot of the ring in
+place, so the counts are written once by the source and read once by the
+writer, and nothing behind the ring can tell a receiver from a replayed file */
+class SampleSource
+{
+public:
+    virtual ~SampleSource() {}
+
+    /*fill all of block.samples, its time stamp and flags, false when the source has ended*/
+    virtual bool read(RxBlock& block, AcquisitionStats& stats) = 0;
+    /*center frequency and sample rate of the counts, Hz*/
+    virtual double freq() const = 0;
+    virtual double sampleRate() const = 0;
+    /*move the center to `freq`, the first samples read afterwards may still be settling. Throws when the source cannot be tuned*/
+    virtual void tune(double freq);
+    /*drop samples queued before now, the next read starts with fresh ones*/
+    virtual void flush() {}
+};
+
+/*
+read exactly block.samples.size() samples, looping over short reads,
+timeouts and overflows. Time stamp of the first sample goes to block.timeNs */
+void readBlock(SoapySDR::Device* device, SoapySDR::Stream* stream, RxBlock& block, AcquisitionStats& stats);
+
+/*
+SoapySDR receiver with serial number `serial`, the first enumerated one when it
+is empty, tuned and streaming CS8 from construction until destruction */
+class SoapySource : public SampleSource
+{
+public:
+    SoapySource(double freq, double sampleRate, int gain, int bandwidth, const std::string& serial = "");
+    ~SoapySource();
+    SoapySource(const SoapySource&) = delete;
+    SoapySource& operator=(const SoapySource&) = delete;
+
+    bool read(RxBlock& block, AcquisitionStats& stats) override;
+    double freq() const override { return centerFreq; }
+    double sampleRate() const override { return rate; }
+    void tune(double freq) override;
+    void flush() override;
+
+private:
+    SoapySDR::Device* device = nullptr;
+    SoapySDR::Stream* stream = nullptr;
+    SoapySDR::RangeList freqRanges;
+    double centerFreq;
+    double rate;
+};
+
+/*
+RX thread body: read `numberOfBlocks` blocks (or until `stop` when it is negative)
+from the source into the ring, stops early when the source ends. Blocks that
+find the ring full are still read, so the device does not overflow, and
+counted as ring overruns   */
+void receiveBlocks(SampleSource& source, SpscRing<RxBlock>& ring,
+                   int blockLenght, long long numberOfBlocks, const std::atomic<bool>& stop,
+                   AcquisitionStats& stats, size_t& highWaterMark);
+
+/*checks that every saved block starts where the previous one ended*/
+class ContinuityChecker
+{
+public:
+    ContinuityChecker(double sampleRate, int blockLenght);
+    void check(const RxBlock& block, AcquisitionStats& stats);
+
+private:
+    double sampleRate;
+    double blockNs;
+    long long lastTimeNs = 0;
+    bool haveLast = false;
+};
+
+#endif
@@ -0,0 +1,484 @@
+/*
+radar_bench: throughput, latency and memory of every stage between the receiver
+and the disk or the screen, without a receiver. Counts come from the synthetic
+receiver (tones, noise and meteor echoes, fixed seed) or from a replayed .iq file,
+so two runs on the same machine can be compared to catch regressions.
+*/
+
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <argp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "spectrum.h"
+#include "kernels.h"
+#include "iqfile.h"
+#include "ringbuffer.h"
+#include "rxblock.h"
+#include "synthetic.h"
+#include "parse.h"
+
+struct benchArguments
+{
+    std::vector<int> lenghts = {256, 1024, 4096, 16384};   //use -l to change it
+    std::vector<int> threads = {1, 2, 4};                   //use -j to change it, 0 means all cores
+    long long samples = 1 << 24;                            //use -n to change it, per stage
+    uint64_t seed = 1;                                      //use -s to change it
+    std::string replayFileName = "";                        //use -f to change it
+    std::string csvFileName = "";                           //use -o to change it
+    std::string planner = "measure";                        //use -P to change it
+};
+
+/*blocks handed to the FFT and the averager per call, like plot() does*/
+constexpr int batchBlocks = 64;
+/*scratch capture written by the write stages and read by the replay stages*/
+const std::string scratchFileName = "radar_bench.iq";
+
+/*one line of the report*/
+struct StageResult
+{
+    std::string stage;
+    int lenght = 0;
+    int threads = 1;
+    long long samples = 0;
+    double seconds = 0;
+    std::vector<double> latenciesUs;    //one per call
+    long peakRssKb = 0;
+};
+
+static int resolveThreads(int threads)
+{
+    return threads > 0 ? threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+/*comma separated whole numbers, every one within [low, high]*/
+static std::vector<int> parseList(const std::string& text, double low, double high)
+{
+    std::vector<int> values;
+    std::stringstream stream(text);
+    std::string item;
+    while(std::getline(stream, item, ','))
+    {
+        values.push_back(parseInteger(item, low, high));
+    }
+    if(values.empty())
+    {
+        throw std::invalid_argument{"empty list"};
+    }
+    return values;
+}
+
+static int parse_bench(int key, char* arg, struct argp_state* state)
+{
+    benchArguments* arguments = reinterpret_cast<benchArguments*>(state->input);
+    const std::string strArg = arg != 0 ? arg : "";
+    try
+    {
+        switch(key)
+        {
+        case 'l':
+            arguments->lenghts = parseList(strArg, 16, 1 << 24);
+            break;
+        case 'j':
+            arguments->threads = parseList(strArg, 0, 4096);
+            break;
+        case 'n':
+            arguments->samples = parseInteger(strArg, 1, 2e9);
+            break;
+        case 's':
+            arguments->seed = parseInteger(strArg, 0, 2e9);
+            break;
+        case 'f':
+            arguments->replayFileName = strArg;
+            break;
+        case 'o':
+            arguments->csvFileName = strArg;
+            break;
+        case 'P':
+            plannerFlags(strArg);
+            arguments->planner = strArg;
+            break;
+        }
+    }
+    catch(const std::invalid_argument& e)
+    {
+        argp_failure(state, 1, 0, "-%c: %s", key, e.what());
+    }
+    return 0;
+}
+
+/*
+peak resident set since the last reset. Linux resets VmHWM when 5 is written
+to clear_refs, elsewhere this is the peak of the whole run */
+static void resetPeakRss()
+{
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+}
+
+static long peakRssKb()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line))
+    {
+        if(line.compare(0, 6, "VmHWM:") == 0)
+        {
+            return std::stol(line.substr(6));
+        }
+    }
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/*
+calls `step` until `total` samples went through it, every call timed on its own.
+step(done) handles the samples from `done` on and returns how many it took */
+template<typename Step>
+static StageResult runStage(const std::string& stage, int lenght, int threads, long long total, Step step)
+{
+    StageResult result;
+    result.stage = stage;
+    result.lenght = lenght;
+    result.threads = threads;
+    resetPeakRss();
+    const auto start = std::chrono::steady_clock::now();
+    while(result.samples < total)
+    {
+        const auto callStart = std::chrono::steady_clock::now();
+        const long long taken = step(result.samples);
+        result.latenciesUs.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - callStart).count());
+        if(taken <= 0)
+        {
+            break;
+        }
+        result.samples += taken;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.peakRssKb = peakRssKb();
+    return result;
+}
+
+static double percentile(std::vector<double> values, double p)
+{
+    if(values.empty())
+    {
+        return 0;
+    }
+    const size_t k = std::min(values.size() - 1, static_cast<size_t>(p / 100 * values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+const char* const reportColumns[] = {"stage", "lenght", "threads", "Msamples/s", "MB/s", "p50 us", "p99 us", "max us", "peak RSS MB"};
+
+static void report(std::ostream& out, const StageResult& r, bool csv)
+{
+    const double samplesPerSecond = r.seconds > 0 ? r.samples / r.seconds : 0;
+    const double maxUs = r.latenciesUs.empty() ? 0 : *std::max_element(r.latenciesUs.begin(), r.latenciesUs.end());
+    const std::string separator = csv ? "," : " ";
+    const int width = csv ? 0 : 11;
+    out << std::fixed << std::setprecision(2)
+        << (csv ? std::setw(0) : std::setw(16)) << std::left << r.stage << std::right
+        << separator << std::setw(width) << r.lenght
+        << separator << std::setw(width) << r.threads
+        << separator << std::setw(width) << samplesPerSecond / 1e6
+        << separator << std::setw(width) << samplesPerSecond * sizeof(std::complex<int8_t>) / 1e6
+        << separator << std::setw(width) << percentile(r.latenciesUs, 50)
+        << separator << std::setw(width) << percentile(r.latenciesUs, 99)
+        << separator << std::setw(width) << maxUs
+        << separator << std::setw(width) << r.peakRssKb / 1024.0 << std::endl;
+}
+
+/*evict a capture from the page cache, so replay reads the disk and not memory*/
+static void dropFromPageCache(const std::string& fileName)
+{
+    const int fd = open(fileName.c_str(), O_RDONLY);
+    if(fd >= 0)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+/*read every block of a capture, `threads` decode a coded one*/
+static StageResult replayStage(const std::string& stage, const std::string& fileName, int threads)
+{
+    dropFromPageCache(fileName);
+    IqFile file(fileName);
+    const int N = file.header().blockLenght;
+    IqChunkReader reader(file, batchBlocks, 0, -1, threads);
+    volatile int8_t sink = 0;
+    return runStage(stage, N, threads, file.blocks() * N, [&](long long)
+    {
+        const std::complex<int8_t>* chunk;
+        long long blocks;
+        if(!reader.next(chunk, blocks))
+        {
+            return 0LL;
+        }
+        /*touch one count per page so the data really is read*/
+        const int8_t* bytes = reinterpret_cast<const int8_t*>(chunk);
+        for(long long i = 0; i < blocks * N * 2; i += 4096)
+        {
+            sink = bytes[i];
+        }
+        return blocks * N;
+    });
+}
+
+/*
+RX thread to ring to writer thread as in measure(), the synthetic receiver
+stands in for readStream. Latency is from publishing a block to its write */
+static StageResult acquireStage(const benchArguments& arguments, int lenght, IqCodec codec)
+{
+    typedef std::chrono::steady_clock Clock;
+    SyntheticSettings settings;
+    settings.seed = arguments.seed;
+    SyntheticSignal signal(settings);
+    IqHeader header;
+    header.sampleRate = settings.sampleRate;
+    header.blockLenght = lenght;
+    header.codec = codec;
+    IqWriter writer(scratchFileName, header);
+
+    RxBlock prototype;
+    prototype.samples.resize(lenght);
+    SpscRing<RxBlock> ring(256, prototype);
+    const long long blocks = std::max(1LL, arguments.samples / lenght);
+    std::atomic<bool> done{false};
+    resetPeakRss();
+    const auto start = Clock::now();
+    std::thread rx([&]()
+    {
+        for(long long b = 0; b < blocks;)
+        {
+            RxBlock* slot = ring.acquire();
+            if(slot == nullptr)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            signal.generate(slot->samples.data(), lenght);
+            slot->timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+            slot->flags = 0;
+            ring.publish();
+            b++;
+        }
+        done = true;
+    });
+
+    StageResult result;
+    result.stage = codec == IqCodec::none ? "acquire" : "acquire coded";
+    result.lenght = lenght;
+    while(true)
+    {
+        RxBlock* block = ring.front();
+        if(block == nullptr)
+        {
+            if(done && ring.occupancy() == 0)
+            {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        writer.write(block->samples.data(), block->timeNs, block->flags);
+        const long long nowNs = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+        result.latenciesUs.push_back((nowNs - block->timeNs) / 1e3);
+        result.samples += lenght;
+        ring.pop();
+    }
+    rx.join();
+    writer.close();
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.peakRssKb = peakRssKb();
+    return result;
+}
+
+static void benchLenght(const benchArguments& arguments, int N, std::vector<StageResult>& results)
+{
+    const unsigned flags = plannerFlags(arguments.planner);
+    const long long total = arguments.samples;
+    SyntheticSettings settings;
+    settings.seed = arguments.seed;
+
+    /*counts the in-memory stages work on, enough for one call of the widest averager*/
+    int maxThreads = 1;
+    for(int threads : arguments.threads)
+    {
+        maxThreads = std::max(maxThreads, resolveThreads(threads));
+    }
+    const long long blocks = std::max<long long>(static_cast<long long>(batchBlocks) * maxThreads, total / N);
+    std::vector<std::complex<int8_t>> counts(static_cast<size_t>(blocks) * N);
+    {
+        SyntheticSignal signal(settings);
+        results.push_back(runStage("synthetic", N, 1, total, [&](long long done)
+        {
+            const long long b = (done / N) % blocks;
+            signal.generate(counts.data() + b * N, N);
+            return static_cast<long long>(N);
+        }));
+    }
+
+    /*int8 to float, one block per call*/
+    std::vector<float> converted(2 * static_cast<size_t>(N));
+    results.push_back(runStage("convert", N, 1, total, [&](long long done)
+    {
+        convertCs8(counts.data() + ((done / N) % blocks) * N, converted.data(), N, 0, 0);
+        return static_cast<long long>(N);
+    }));
+
+    /*batched FFT of batchBlocks blocks, conversion included as in the averager*/
+    {
+        SpectrumEngine engine(flags);
+        engine.prepare(N, batchBlocks);
+        std::vector<float> power(N);
+        results.push_back(runStage("fft", N, 1, total, [&](long long done)
+        {
+            const long long b = (done / N) % (blocks - batchBlocks + 1);
+            engine.load(counts.data() + b * N, N, batchBlocks, N);
+            engine.execute(N, batchBlocks);
+            engine.accumulatePower(power.data(), N, batchBlocks);
+            return static_cast<long long>(batchBlocks) * N;
+        }));
+    }
+
+    /*the whole Welch estimator, spread over every thread count*/
+    for(int threads : arguments.threads)
+    {
+        WelchSettings welch;
+        welch.lenght = N;
+        welch.batchSegments = batchBlocks;
+        welch.threads = threads;
+        welch.flags = flags;
+        SpectrumAverager averager(welch);
+        const int resolved = resolveThreads(threads);
+        const long long chunk = static_cast<long long>(batchBlocks) * N * resolved;
+        results.push_back(runStage("average", N, resolved, total, [&](long long done)
+        {
+            const long long start = (done % (static_cast<long long>(counts.size()) - chunk + 1));
+            averager.process(counts.data() + start, chunk);
+            return chunk;
+        }));
+    }
+
+    /*disk, raw and coded, then the same captures read back*/
+    for(IqCodec codec : {IqCodec::none, IqCodec::rice})
+    {
+        const std::string stage = codec == IqCodec::none ? "write" : "write coded";
+        {
+            IqHeader header;
+            header.sampleRate = settings.sampleRate;
+            header.blockLenght = N;
+            header.codec = codec;
+            IqWriter writer(scratchFileName, header);
+            results.push_back(runStage(stage, N, 1, total, [&](long long done)
+            {
+                writer.write(counts.data() + ((done / N) % blocks) * N, done, blockHasTime);
+                return static_cast<long long>(N);
+            }));
+            writer.close();
+        }
+        /*only a coded capture has anything to split between threads*/
+        for(int threads : arguments.threads)
+        {
+            results.push_back(replayStage(codec == IqCodec::none ? "replay" : "replay coded", scratchFileName,
+                                          resolveThreads(threads)));
+            if(codec == IqCodec::none)
+            {
+                break;
+            }
+        }
+        results.push_back(acquireStage(arguments, N, codec));
+    }
+    std::remove(scratchFileName.c_str());
+    std::remove((scratchFileName + ".idx").c_str());
+}
+
+int main(int argc, char** argv)
+{
+    argp_option options[] =
+    {
+        {0, 'l', "LENGHTS", 0, "block lenghts to run, comma separated (default 256,1024,4096,16384)"},
+        {0, 'j', "THREADS", 0, "thread counts for the averager and the decoder, comma separated, 0 is every core (default 1,2,4)"},
+        {0, 'n', "SAMPLES", 0, "samples every stage processes (default 16777216)"},
+        {0, 's', "SEED", 0, "seed of the synthetic receiver (default 1)"},
+        {0, 'f', "FILE_NAME", 0, "also replay FILE_NAME, a capture from a station"},
+        {0, 'o', "OUTPUT_FILE_NAME", 0, "save the results as csv"},
+        {0, 'P', "PLANNER", 0, "FFTW planner: estimate, measure (default), patient or exhaustive"},
+        {0}
+    };
+    benchArguments arguments;
+    struct argp argpStruct = {options, parse_bench};
+    argp_parse(&argpStruct, argc, argv, 0, 0, &arguments);
+
+    std::cout << "Kernels: " << kernelsName() << ", cores: " << std::thread::hardware_concurrency()
+              << ", " << arguments.samples << " samples per stage" << std::endl;
+    std::cout << std::setw(16) << std::left << reportColumns[0] << std::right;
+    for(size_t c = 1; c < sizeof(reportColumns) / sizeof(reportColumns[0]); c++)
+    {
+        std::cout << " " << std::setw(11) << reportColumns[c];
+    }
+    std::cout << std::endl;
+
+    std::vector<StageResult> results;
+    try
+    {
+        for(int N : arguments.lenghts)
+        {
+            const size_t first = results.size();
+            benchLenght(arguments, N, results);
+            for(size_t i = first; i < results.size(); i++)
+            {
+                report(std::cout, results[i], false);
+            }
+        }
+        if(!arguments.replayFileName.empty())
+        {
+            for(int threads : arguments.threads)
+            {
+                results.push_back(replayStage("replay file", arguments.replayFileName, resolveThreads(threads)));
+                report(std::cout, results.back(), false);
+            }
+        }
+    }
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+
+    if(!arguments.csvFileName.empty())
+    {
+        std::ofstream csv(arguments.csvFileName, std::ios::trunc);
+        for(size_t c = 0; c < sizeof(reportColumns) / sizeof(reportColumns[0]); c++)
+        {
+            csv << (c > 0 ? "," : "") << reportColumns[c];
+        }
+        csv << std::endl;
+        for(const StageResult& r : results)
+        {
+            report(csv, r, true);
+        }
+        if(!csv)
+        {
+            std::cerr << "Writing to " << arguments.csvFileName << " failed" << '\n';
+            return 1;
+        }
+    }
+    return 0;
+}
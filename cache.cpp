@@ -0,0 +1,308 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <glob.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+constexpr uint64_t prime1 = 0x9e3779b185ebca87ULL;
+constexpr uint64_t prime2 = 0xc2b2ae3d27d4eb4fULL;
+
+static inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t load64(const unsigned char* p)
+{
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    return word;
+}
+
+/*final avalanche, every input bit affects every output bit*/
+static inline uint64_t avalanche(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+Hasher::Hasher(uint64_t seed)
+{
+    lanes[0] = seed + prime1 + prime2;
+    lanes[1] = seed + prime2;
+    lanes[2] = seed;
+    lanes[3] = seed - prime1;
+}
+
+void Hasher::consume(const unsigned char* block)
+{
+    for(int l = 0; l < 4; l++)
+    {
+        lanes[l] = rotl(lanes[l] + load64(block + 8 * l) * prime2, 31) * prime1;
+    }
+}
+
+void Hasher::update(const void* data, size_t size)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    total += size;
+    if(tailSize > 0)
+    {
+        const size_t take = std::min(size, sizeof(tail) - tailSize);
+        std::memcpy(tail + tailSize, p, take);
+        tailSize += take;
+        p += take;
+        size -= take;
+        if(tailSize < sizeof(tail))
+        {
+            return;
+        }
+        consume(tail);
+        tailSize = 0;
+    }
+    for(; size >= 32; p += 32, size -= 32)
+    {
+        consume(p);
+    }
+    std::memcpy(tail, p, size);
+    tailSize = size;
+}
+
+uint64_t Hasher::digest() const
+{
+    uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+    h ^= total * prime1;
+    size_t i = 0;
+    for(; i + 8 <= tailSize; i += 8)
+    {
+        h = rotl(h ^ (load64(tail + i) * prime2), 27) * prime1;
+    }
+    for(; i < tailSize; i++)
+    {
+        h = rotl(h ^ (tail[i] * prime1), 11) * prime2;
+    }
+    return avalanche(h);
+}
+
+uint64_t hashString(const std::string& text)
+{
+    Hasher hasher;
+    hasher.update(text.data(), text.size());
+    return hasher.digest();
+}
+
+static std::string hex(uint64_t value)
+{
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(value));
+    return text;
+}
+
+SpectrumCache::SpectrumCache(const std::string& directory)
+    : directory(directory)
+{
+    if(mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        throw std::runtime_error{"Cannot create " + directory};
+    }
+}
+
+/*what is remembered of a path to tell that it did not change*/
+struct FileStamp
+{
+    int64_t size = 0;
+    int64_t inode = 0;
+    int64_t mtimeNs = 0;
+    uint64_t content = 0;
+};
+
+/*temporary name unique to the writing thread, renamed into place once complete*/
+static std::string temporaryName(const std::string& name)
+{
+    return name + ".tmp" + std::to_string(getpid()) + "_" +
+           std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+}
+
+uint64_t SpectrumCache::contentHash(const std::string& fileName) const
+{
+    struct stat st;
+    if(stat(fileName.c_str(), &st) != 0)
+    {
+        throw std::runtime_error{"Cannot open the " + fileName};
+    }
+    FileStamp now;
+    now.size = st.st_size;
+    now.inode = st.st_ino;
+    now.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+
+    /*the same path with the same size, inode and time is taken as unchanged*/
+    char* absolute = realpath(fileName.c_str(), nullptr);
+    const std::string path = absolute ? absolute : fileName;
+    std::free(absolute);
+    const std::string stampName = directory + "/" + hex(hashString(path)) + ".stamp";
+    FileStamp saved;
+    std::ifstream stampFile(stampName, std::ios::binary);
+    if(stampFile.read(reinterpret_cast<char*>(&saved), sizeof(saved)) && saved.size == now.size &&
+       saved.inode == now.inode && saved.mtimeNs == now.mtimeNs)
+    {
+        return saved.content;
+    }
+
+    const int fd = open(fileName.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        throw std::runtime_error{"Cannot open the " + fileName};
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    Hasher hasher;
+    std::vector<char> buffer(4 << 20);
+    ssize_t got;
+    while((got = read(fd, buffer.data(), buffer.size())) > 0)
+    {
+        hasher.update(buffer.data(), got);
+    }
+    close(fd);
+    if(got < 0)
+    {
+        throw std::runtime_error{"Reading " + fileName + " failed"};
+    }
+    now.content = hasher.digest();
+
+    const std::string temporary = temporaryName(stampName);
+    std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&now), sizeof(now));
+    out.close();
+    if(!out || std::rename(temporary.c_str(), stampName.c_str()) != 0)
+    {
+        std::remove(temporary.c_str());
+    }
+    return now.content;
+}
+
+std::string SpectrumCache::entryName(uint64_t content, uint64_t settings) const
+{
+    return directory + "/" + hex(content) + "-" + hex(settings) + ".psd";
+}
+
+/*
+entry: magic, int32 version, int32 bins, double freq, double sampleRate,
+double enbwHz, int64 blocks, int64 segments, then bins freqMHz and bins dbfsPerHz doubles */
+constexpr char entryMagic[4] = {'P', 'S', 'D', 'C'};
+constexpr int32_t entryVersion = 1;
+
+bool SpectrumCache::load(uint64_t content, uint64_t settings, CachedSpectrum& entry) const
+{
+    std::ifstream file(entryName(content, settings), std::ios::binary);
+    if(!file.is_open())
+    {
+        return false;
+    }
+    char magic[4];
+    int32_t version, bins;
+    int64_t blocks, segments;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&bins), sizeof(bins));
+    file.read(reinterpret_cast<char*>(&entry.freq), sizeof(entry.freq));
+    file.read(reinterpret_cast<char*>(&entry.sampleRate), sizeof(entry.sampleRate));
+    file.read(reinterpret_cast<char*>(&entry.psd.enbwHz), sizeof(entry.psd.enbwHz));
+    file.read(reinterpret_cast<char*>(&blocks), sizeof(blocks));
+    file.read(reinterpret_cast<char*>(&segments), sizeof(segments));
+    if(!file || std::memcmp(magic, entryMagic, sizeof(magic)) != 0 || version != entryVersion || bins <= 0)
+    {
+        return false;
+    }
+    entry.blocks = blocks;
+    entry.segments = segments;
+    entry.psd.freqMHz.resize(bins);
+    entry.psd.dbfsPerHz.resize(bins);
+    file.read(reinterpret_cast<char*>(entry.psd.freqMHz.data()), bins * sizeof(double));
+    file.read(reinterpret_cast<char*>(entry.psd.dbfsPerHz.data()), bins * sizeof(double));
+    return static_cast<bool>(file);
+}
+
+bool SpectrumCache::store(uint64_t content, uint64_t settings, const CachedSpectrum& entry) const
+{
+    const std::string name = entryName(content, settings);
+    const std::string temporary = temporaryName(name);
+    std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+    const int32_t bins = static_cast<int32_t>(entry.psd.dbfsPerHz.size());
+    const int64_t blocks = entry.blocks;
+    const int64_t segments = entry.segments;
+    file.write(entryMagic, sizeof(entryMagic));
+    file.write(reinterpret_cast<const char*>(&entryVersion), sizeof(entryVersion));
+    file.write(reinterpret_cast<const char*>(&bins), sizeof(bins));
+    file.write(reinterpret_cast<const char*>(&entry.freq), sizeof(entry.freq));
+    file.write(reinterpret_cast<const char*>(&entry.sampleRate), sizeof(entry.sampleRate));
+    file.write(reinterpret_cast<const char*>(&entry.psd.enbwHz), sizeof(entry.psd.enbwHz));
+    file.write(reinterpret_cast<const char*>(&blocks), sizeof(blocks));
+    file.write(reinterpret_cast<const char*>(&segments), sizeof(segments));
+    file.write(reinterpret_cast<const char*>(entry.psd.freqMHz.data()), bins * sizeof(double));
+    file.write(reinterpret_cast<const char*>(entry.psd.dbfsPerHz.data()), bins * sizeof(double));
+    file.close();
+    if(!file || std::rename(temporary.c_str(), name.c_str()) != 0)
+    {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool isDirectory(const std::string& path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+std::vector<std::string> listCaptures(const std::string& path)
+{
+    std::vector<std::string> files;
+    if(isDirectory(path))
+    {
+        DIR* dir = opendir(path.c_str());
+        if(dir == nullptr)
+        {
+            throw std::runtime_error{"Cannot open the " + path};
+        }
+        while(dirent* item = readdir(dir))
+        {
+            const std::string name = item->d_name;
+            if(name.size() > 3 && name.compare(name.size() - 3, 3, ".iq") == 0)
+            {
+                files.push_back(path + "/" + name);
+            }
+        }
+        closedir(dir);
+    }
+    else
+    {
+        glob_t matches;
+        if(glob(path.c_str(), 0, nullptr, &matches) == 0)
+        {
+            for(size_t i = 0; i < matches.gl_pathc; i++)
+            {
+                if(!isDirectory(matches.gl_pathv[i]))
+                {
+                    files.push_back(matches.gl_pathv[i]);
+                }
+            }
+        }
+        globfree(&matches);
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
@@ -0,0 +1,71 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "spectrum.h"
+
+/*batch runs keep their averaged spectra here, in the working directory*/
+const std::string cacheDirectory = "radar.cache";
+
+/*
+64-bit hash of a byte stream, four independent multiply-rotate lanes so it runs
+at memory speed. Not cryptographic, it only tells captures apart. Chunks may be
+of any size, the digest only depends on the bytes */
+class Hasher
+{
+public:
+    explicit Hasher(uint64_t seed = 0);
+    void update(const void* data, size_t size);
+    uint64_t digest() const;
+
+private:
+    void consume(const unsigned char* block);
+
+    uint64_t lanes[4];
+    unsigned char tail[32];
+    size_t tailSize = 0;
+    uint64_t total = 0;
+};
+uint64_t hashString(const std::string& text);
+
+/*what a batch run keeps of one capture*/
+struct CachedSpectrum
+{
+    double freq = 0;            //center frequency of the spectrum, Hz
+    double sampleRate = 0;
+    long long blocks = 0;       //input blocks that were averaged
+    long long segments = 0;     //Welch segments
+    Psd psd;
+};
+
+/*
+spectra of earlier batch runs. An entry is one file named after the hash of the
+capture's contents and the hash of the settings that shape the spectrum, so a
+capture is averaged again only when either changes. The content hash of a path
+is remembered with its size, inode and modification time, so unchanged captures
+are not even read. Entries are written to a temporary file and renamed, several
+threads may use one cache at once */
+class SpectrumCache
+{
+public:
+    explicit SpectrumCache(const std::string& directory = cacheDirectory);
+
+    /*hash of everything in `fileName`, read again only when the file changed*/
+    uint64_t contentHash(const std::string& fileName) const;
+    bool load(uint64_t content, uint64_t settings, CachedSpectrum& entry) const;
+    /*false when the entry could not be written, the run goes on without it*/
+    bool store(uint64_t content, uint64_t settings, const CachedSpectrum& entry) const;
+
+private:
+    std::string entryName(uint64_t content, uint64_t settings) const;
+
+    std::string directory;
+};
+
+/*.iq files in a directory, or the files matching a glob pattern, sorted by name*/
+std::vector<std::string> listCaptures(const std::string& path);
+
+#endif
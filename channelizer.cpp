@@ -0,0 +1,150 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "channelizer.h"
+#include "metrics.h"
+
+int decimationFor(double sampleRate, double outputRate)
+{
+    if(outputRate <= 0)
+    {
+        return 1;
+    }
+    return std::max(1, static_cast<int>(std::lround(sampleRate / outputRate)));
+}
+
+Channelizer::Channelizer(double sampleRate, double shiftHz, int decimation, int tapsPerPhase)
+    : sampleRate(sampleRate), shiftHz(shiftHz), factor(std::max(1, decimation))
+{
+    if(sampleRate <= 0)
+    {
+        throw std::invalid_argument{"Channelizer needs a positive sample rate"};
+    }
+    gain = static_cast<int>(std::lround(10 * log10(static_cast<double>(factor))));
+
+    /*Blackman windowed sinc, a single tap when there is nothing to filter*/
+    const int lenght = factor > 1 ? factor * std::max(2, tapsPerPhase) : 1;
+    const double cutoff = 0.42 / factor;   //cycles per input sample
+    std::vector<double> taps(lenght);
+    double sum = 0;
+    for(int i = 0; i < lenght; i++)
+    {
+        const double t = i - (lenght - 1) / 2.0;
+        const double sinc = t == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * t) / (M_PI * t);
+        const double x = lenght > 1 ? static_cast<double>(i) / (lenght - 1) : 0.5;
+        const double window = 0.42 - 0.5 * cos(2 * M_PI * x) + 0.08 * cos(4 * M_PI * x);
+        taps[i] = sinc * window;
+        sum += taps[i];
+    }
+    const double amplitude = pow(10.0, gain / 20.0) / sum;
+    h.resize(lenght);
+    for(int i = 0; i < lenght; i++)
+    {
+        h[i] = static_cast<float>(taps[lenght - 1 - i] * amplitude);
+    }
+
+    rotation = std::polar(1.0, -2 * M_PI * shiftHz / sampleRate);
+    reset();
+}
+
+void Channelizer::reset()
+{
+    phasor = 1.0;
+    /*history starts as taps-1 zeros, the first output is due at the first input sample*/
+    filled = h.size() - 1;
+    re.assign(filled, 0.0f);
+    im.assign(filled, 0.0f);
+    nextOutput = filled;
+}
+
+void Channelizer::process(const std::complex<int8_t>* in, size_t count, std::vector<std::complex<int8_t>>& out)
+{
+    if(count == 0)
+    {
+        return;
+    }
+    if(re.size() < filled + count)
+    {
+        re.resize(filled + count);
+        im.resize(filled + count);
+    }
+
+    /*NCO: the phasor turns by `rotation` every sample and is renormalised every call*/
+    const int8_t* p = reinterpret_cast<const int8_t*>(in);
+    std::complex<double> phase = phasor;
+    for(size_t i = 0; i < count; i++)
+    {
+        const float c = static_cast<float>(phase.real());
+        const float s = static_cast<float>(phase.imag());
+        const float x = p[2 * i];
+        const float y = p[2 * i + 1];
+        re[filled + i] = x * c - y * s;
+        im[filled + i] = x * s + y * c;
+        phase *= rotation;
+    }
+    phasor = phase / std::abs(phase);
+    filled += count;
+
+    /*only the outputs that are kept are computed*/
+    const size_t taps = h.size();
+    for(; nextOutput < filled; nextOutput += factor)
+    {
+        const float* xr = re.data() + nextOutput + 1 - taps;
+        const float* xi = im.data() + nextOutput + 1 - taps;
+        float accRe = 0;
+        float accIm = 0;
+        for(size_t k = 0; k < taps; k++)
+        {
+            accRe += h[k] * xr[k];
+            accIm += h[k] * xi[k];
+        }
+        const float i8 = std::round(accRe);
+        const float q8 = std::round(accIm);
+        const float ci = std::min(127.0f, std::max(-128.0f, i8));
+        const float cq = std::min(127.0f, std::max(-128.0f, q8));
+        if(ci != i8 || cq != q8)
+        {
+            clippedCount++;
+        }
+        out.emplace_back(static_cast<int8_t>(ci), static_cast<int8_t>(cq));
+    }
+
+    /*keep the last taps-1 samples for the next call*/
+    const size_t keep = taps - 1;
+    const size_t drop = filled - keep;
+    std::copy(re.begin() + drop, re.begin() + filled, re.begin());
+    std::copy(im.begin() + drop, im.begin() + filled, im.begin());
+    filled = keep;
+    nextOutput -= drop;
+}
+
+DecimatedBlocks::DecimatedBlocks(Channelizer& channelizer, int lenght, Sink sink)
+    : channelizer(channelizer), lenght(std::max(1, lenght)), sink(sink)
+{
+}
+
+void DecimatedBlocks::push(const std::complex<int8_t>* samples, size_t count, long long timeNs, int flags)
+{
+    /*output j of this call is taken at input sample first + j * decimation*/
+    const size_t first = channelizer.inputsBeforeOutput();
+    const size_t before = output.size();
+    const double nsPerInput = 1e9 / channelizer.inputRate();
+    if(output.empty())
+    {
+        blockTimeNs = timeNs + std::llround(first * nsPerInput);
+        blockFlags = 0;
+    }
+    blockFlags |= flags;
+    {
+        METRICS_TIME(Stage::decimate);
+        channelizer.process(samples, count, output);
+    }
+    for(size_t emitted = lenght; output.size() >= lenght; emitted += lenght)
+    {
+        sink(output.data(), blockTimeNs, blockFlags);
+        output.erase(output.begin(), output.begin() + lenght);
+        /*the rest started in this input block, at its output number emitted - before*/
+        blockTimeNs = timeNs + std::llround((first + (emitted - before) * channelizer.decimation()) * nsPerInput);
+        blockFlags = flags;
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef _CHANNELIZER_H
+#define _CHANNELIZER_H
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+/*decimation that brings sampleRate closest to outputRate, at least 1*/
+int decimationFor(double sampleRate, double outputRate);
+
+/*
+NCO shift followed by a polyphase FIR decimator, int8 counts in and out.
+The channel `shiftHz` away from the center frequency is moved to 0 Hz,
+low-pass filtered and only every `decimation`-th output is computed, so
+the cost is tapsPerPhase complex MACs per input sample whatever the decimation.
+Taps are a Blackman windowed sinc designed on construction, unity gain at DC,
+cut off at 0.42 of the output rate. Output gets gainDb() of digital gain,
+sqrt(decimation) rounded to whole dB, so the narrower noise still spans
+several int8 counts. State carries over between process() calls  */
+class Channelizer
+{
+public:
+    Channelizer(double sampleRate, double shiftHz, int decimation, int tapsPerPhase = 16);
+
+    /*filter `count` input samples, the decimated output is appended to `out`*/
+    void process(const std::complex<int8_t>* in, size_t count, std::vector<std::complex<int8_t>>& out);
+    /*start again from an empty filter and phase 0*/
+    void reset();
+
+    double inputRate() const { return sampleRate; }
+    double outputRate() const { return sampleRate / factor; }
+    double shift() const { return shiftHz; }
+    int decimation() const { return factor; }
+    int gainDb() const { return gain; }
+    size_t taps() const { return h.size(); }
+    /*input samples the next call takes before it makes its first output, that is its index in the call*/
+    size_t inputsBeforeOutput() const { return nextOutput - filled; }
+    /*output counts that had to be clipped to int8*/
+    long long clipped() const { return clippedCount; }
+
+private:
+    double sampleRate;
+    double shiftHz;
+    int factor;
+    int gain;
+    /*taps in reverse order with the gain applied, so an output is a plain dot product with the history*/
+    std::vector<float> h;
+    std::complex<double> phasor;
+    std::complex<double> rotation;
+    /*last taps-1 mixed samples followed by the new ones, i and q kept apart*/
+    std::vector<float> re;
+    std::vector<float> im;
+    size_t filled = 0;
+    /*history index of the newest input sample of the next output*/
+    size_t nextOutput = 0;
+    long long clippedCount = 0;
+};
+
+/*
+gathers channelizer output into blocks of `lenght` samples, e.g. for IqWriter.
+A block gets the time of the input sample its first output was taken at,
+counted from the time stamp of that input block, and the flags of every
+input block that went into it   */
+class DecimatedBlocks
+{
+public:
+    typedef std::function<void(const std::complex<int8_t>* samples, long long timeNs, int flags)> Sink;
+
+    DecimatedBlocks(Channelizer& channelizer, int lenght, Sink sink);
+    /*one input block, may complete any number of output blocks*/
+    void push(const std::complex<int8_t>* samples, size_t count, long long timeNs, int flags);
+
+private:
+    Channelizer& channelizer;
+    size_t lenght;
+    Sink sink;
+    std::vector<std::complex<int8_t>> output;
+    long long blockTimeNs = 0;
+    int blockFlags = 0;
+};
+
+#endif
@@ -0,0 +1,258 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "codec.h"
+
+const char* iqCodecName(IqCodec codec)
+{
+    switch(codec)
+    {
+    case IqCodec::none:
+        return "none";
+    case IqCodec::rice:
+        return "rice";
+    }
+    return "unknown";
+}
+
+enum BlockMethod : uint8_t
+{
+    methodStored = 0,
+    methodRice = 1
+};
+
+/*quotients from this one on are written as escapeQuotient ones and the 8 bit value*/
+constexpr unsigned escapeQuotient = 16;
+constexpr unsigned escapeBits = escapeQuotient + 8;
+constexpr int maxRiceK = 7;
+constexpr size_t riceHeaderSize = 5;
+
+/*small counts either side of 0 become small codes: 0, -1, 1, -2, 2 ...*/
+static inline uint8_t zigzag(int8_t value)
+{
+    return static_cast<uint8_t>((static_cast<uint8_t>(value) << 1) ^ static_cast<uint8_t>(value >> 7));
+}
+
+static inline int8_t unzigzag(uint8_t code)
+{
+    return static_cast<int8_t>((code >> 1) ^ static_cast<uint8_t>(-(code & 1)));
+}
+
+static inline unsigned codeBits(unsigned u, int k)
+{
+    const unsigned q = u >> k;
+    return q < escapeQuotient ? q + 1 + k : escapeBits;
+}
+
+/*bias and Rice parameter of one channel, and the bits it will take*/
+struct ChannelCode
+{
+    int8_t bias = 0;
+    int k = 0;
+    size_t bits = 0;
+};
+
+static ChannelCode chooseCode(const int8_t* p, size_t count)
+{
+    ChannelCode code;
+    long long sum = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        sum += p[2 * i];
+    }
+    code.bias = static_cast<int8_t>(std::max(-128LL, std::min(127LL, std::llround(static_cast<double>(sum) / count))));
+
+    /*cost of every k from one histogram of the codes*/
+    size_t histogram[256] = {};
+    for(size_t i = 0; i < count; i++)
+    {
+        histogram[zigzag(static_cast<int8_t>(p[2 * i] - code.bias))]++;
+    }
+    code.bits = SIZE_MAX;
+    for(int k = 0; k <= maxRiceK; k++)
+    {
+        size_t bits = 0;
+        for(unsigned u = 0; u < 256; u++)
+        {
+            bits += histogram[u] * codeBits(u, k);
+        }
+        if(bits < code.bits)
+        {
+            code.bits = bits;
+            code.k = k;
+        }
+    }
+    return code;
+}
+
+/*LSB first bit packing into a buffer that is large enough*/
+class BitWriter
+{
+public:
+    explicit BitWriter(uint8_t* out) : out(out) {}
+
+    void put(uint64_t code, unsigned bits)
+    {
+        acc |= code << filled;
+        filled += bits;
+        while(filled >= 8)
+        {
+            *out++ = static_cast<uint8_t>(acc);
+            acc >>= 8;
+            filled -= 8;
+        }
+    }
+    uint8_t* finish()
+    {
+        if(filled > 0)
+        {
+            *out++ = static_cast<uint8_t>(acc);
+        }
+        return out;
+    }
+
+private:
+    uint8_t* out;
+    uint64_t acc = 0;
+    unsigned filled = 0;
+};
+
+static void encodeChannel(const int8_t* p, size_t count, const ChannelCode& code, BitWriter& writer)
+{
+    const unsigned k = code.k;
+    const unsigned mask = (1u << k) - 1;
+    for(size_t i = 0; i < count; i++)
+    {
+        const unsigned u = zigzag(static_cast<int8_t>(p[2 * i] - code.bias));
+        const unsigned q = u >> k;
+        if(q < escapeQuotient)
+        {
+            /*q ones, a zero, then the k low bits*/
+            writer.put(((1u << q) - 1) | ((u & mask) << (q + 1)), q + 1 + k);
+        }
+        else
+        {
+            writer.put(((1u << escapeQuotient) - 1) | (u << escapeQuotient), escapeBits);
+        }
+    }
+}
+
+void encodeBlock(const std::complex<int8_t>* in, size_t count, std::vector<uint8_t>& out)
+{
+    const int8_t* p = reinterpret_cast<const int8_t*>(in);
+    const ChannelCode codeI = chooseCode(p, count);
+    const ChannelCode codeQ = chooseCode(p + 1, count);
+    const size_t storedBytes = 1 + 2 * count;
+    const size_t riceBytes = riceHeaderSize + (codeI.bits + codeQ.bits + 7) / 8;
+    const size_t start = out.size();
+
+    if(riceBytes >= storedBytes)
+    {
+        /*nothing to gain, e.g. a block of strong signal at high gain*/
+        out.resize(start + storedBytes);
+        out[start] = methodStored;
+        std::memcpy(out.data() + start + 1, p, 2 * count);
+        return;
+    }
+    out.resize(start + riceBytes);
+    uint8_t* header = out.data() + start;
+    header[0] = methodRice;
+    header[1] = static_cast<uint8_t>(codeI.bias);
+    header[2] = static_cast<uint8_t>(codeI.k);
+    header[3] = static_cast<uint8_t>(codeQ.bias);
+    header[4] = static_cast<uint8_t>(codeQ.k);
+    BitWriter writer(header + riceHeaderSize);
+    encodeChannel(p, count, codeI, writer);
+    encodeChannel(p + 1, count, codeQ, writer);
+    writer.finish();
+}
+
+/*LSB first bit reader that never reads past `end`, missing bits read as zeros*/
+class BitReader
+{
+public:
+    BitReader(const uint8_t* in, const uint8_t* end) : in(in), end(end) {}
+
+    /*at least 24 bits are buffered afterwards unless the block ends*/
+    void refill()
+    {
+        while(filled <= 56 && in < end)
+        {
+            acc |= static_cast<uint64_t>(*in++) << filled;
+            filled += 8;
+        }
+    }
+    uint64_t peek() const { return acc; }
+    bool consume(unsigned bits)
+    {
+        if(bits > filled)
+        {
+            return false;
+        }
+        acc >>= bits;
+        filled -= bits;
+        return true;
+    }
+
+private:
+    const uint8_t* in;
+    const uint8_t* end;
+    uint64_t acc = 0;
+    unsigned filled = 0;
+};
+
+static bool decodeChannel(BitReader& reader, int8_t bias, int k, int8_t* p, size_t count)
+{
+    const unsigned mask = (1u << k) - 1;
+    for(size_t i = 0; i < count; i++)
+    {
+        reader.refill();
+        const uint64_t bits = reader.peek();
+        /*ones before the first zero, capped at the escape*/
+        const unsigned q = __builtin_ctzll(~bits | (1ull << escapeQuotient));
+        unsigned u;
+        if(q >= escapeQuotient)
+        {
+            u = static_cast<unsigned>(bits >> escapeQuotient) & 0xff;
+            if(!reader.consume(escapeBits))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            u = (q << k) | (static_cast<unsigned>(bits >> (q + 1)) & mask);
+            if(!reader.consume(q + 1 + k))
+            {
+                return false;
+            }
+        }
+        p[2 * i] = static_cast<int8_t>(unzigzag(static_cast<uint8_t>(u)) + bias);
+    }
+    return true;
+}
+
+bool decodeBlock(const uint8_t* in, size_t bytes, std::complex<int8_t>* out, size_t count)
+{
+    int8_t* p = reinterpret_cast<int8_t*>(out);
+    if(bytes == 0)
+    {
+        return false;
+    }
+    if(in[0] == methodStored)
+    {
+        if(bytes != 1 + 2 * count)
+        {
+            return false;
+        }
+        std::memcpy(p, in + 1, 2 * count);
+        return true;
+    }
+    if(in[0] != methodRice || bytes < riceHeaderSize || in[2] > maxRiceK || in[4] > maxRiceK)
+    {
+        return false;
+    }
+    BitReader reader(in + riceHeaderSize, in + bytes);
+    return decodeChannel(reader, static_cast<int8_t>(in[1]), in[2], p, count) &&
+           decodeChannel(reader, static_cast<int8_t>(in[3]), in[4], p + 1, count);
+}
@@ -0,0 +1,30 @@
+#ifndef _CODEC_H
+#define _CODEC_H
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <cstddef>
+
+/*how the blocks of a v2 .iq file are stored*/
+enum class IqCodec : int32_t
+{
+    none = 0,       //raw interleaved counts
+    rice = 1        //every block coded on its own, see encodeBlock
+};
+const char* iqCodecName(IqCodec codec);
+
+/*
+lossless coding of one block of CS8 counts. Every block stands alone, so any
+block can be decoded without the ones before it, on any thread.
+Layout: one method byte, 0 stores the counts as they are, 1 is followed by
+int8 bias and uint8 k of the i counts, the same for the q counts, then one
+bit stream: every i count, then every q count. A count is taken minus its
+channel bias, zigzag mapped to 0..255 and Rice coded with parameter k,
+quotients of 16 and more are escaped to the 8 bit value. Bits are packed
+LSB first. The smaller of the two methods is kept */
+void encodeBlock(const std::complex<int8_t>* in, size_t count, std::vector<uint8_t>& out);
+/*decode a block of `count` samples from `bytes` bytes, false when it is damaged*/
+bool decodeBlock(const uint8_t* in, size_t bytes, std::complex<int8_t>* out, size_t count);
+
+#endif
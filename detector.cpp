@@ -0,0 +1,133 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+#include "detector.h"
+
+MeteorDetector::MeteorDetector(const DetectorSettings& settings, int bins, double sampleRate, double spectrumSeconds)
+    : settings(settings), bins(bins), binHz(sampleRate / bins),
+      spectrumNs(static_cast<long long>(spectrumSeconds * 1e9)),
+      floorDb(bins, 0.0), floorPower(bins, 0.0), floorSum(bins + 1, 0.0)
+{
+    /*bins are fftshift-ed, bin bins/2 is the center frequency*/
+    carrierBin = bins / 2 + static_cast<int>(std::lround(settings.carrierOffsetHz / binHz));
+    const int span = static_cast<int>(std::ceil(settings.searchHz / binHz));
+    firstBin = std::max(0, carrierBin - span);
+    lastBin = std::min(bins - 1, carrierBin + span);
+    /*a carrier off the spectrum would leave a detector that never fires*/
+    if(carrierBin < 0 || carrierBin >= bins || firstBin > lastBin)
+    {
+        throw std::invalid_argument{"The carrier at " + std::to_string(std::llround(settings.carrierOffsetHz)) +
+            " Hz from the center is outside the spectrum of +-" + std::to_string(std::llround(binHz * bins / 2)) + " Hz"};
+    }
+    /*the floor needs at least one spectrum to start from*/
+    this->settings.warmupSpectra = std::max(1, settings.warmupSpectra);
+}
+
+bool MeteorDetector::process(long long timeNs, const std::vector<double>& db)
+{
+    spectrumCount++;
+    if(spectrumCount <= settings.warmupSpectra)
+    {
+        /*running mean gives the floor a start close to its final value*/
+        for(int k = 0; k < bins; k++)
+        {
+            floorDb[k] += (db[k] - floorDb[k]) / spectrumCount;
+        }
+        return false;
+    }
+
+    /*reference level of every cell: mean floor power of the cells around it, guard cells excluded*/
+    for(int k = 0; k < bins; k++)
+    {
+        floorPower[k] = std::pow(10.0, floorDb[k] / 10);
+        floorSum[k + 1] = floorSum[k] + floorPower[k];
+    }
+    const int guard = settings.guardBins;
+    const int reference = std::max(1, settings.referenceBins);
+
+    bool crossing = false;
+    for(int k = firstBin; k <= lastBin; k++)
+    {
+        /*cells on either side, clipped at the edges of the spectrum*/
+        const int leftEnd = std::max(0, k - guard);
+        const int leftBegin = std::max(0, k - guard - reference);
+        const int rightBegin = std::min(bins, k + guard + 1);
+        const int rightEnd = std::min(bins, k + guard + 1 + reference);
+        const int cells = (leftEnd - leftBegin) + (rightEnd - rightBegin);
+        double referencePower = floorPower[k];
+        if(cells > 0)
+        {
+            referencePower = (floorSum[leftEnd] - floorSum[leftBegin] + floorSum[rightEnd] - floorSum[rightBegin]) / cells;
+        }
+        const double snr = db[k] - 10 * std::log10(referencePower);
+        if(snr < settings.thresholdDb)
+        {
+            continue;
+        }
+        if(!open)
+        {
+            open = true;
+            current = MeteorEvent();
+            current.startNs = timeNs;
+            current.snrDb = std::numeric_limits<double>::lowest();
+        }
+        if(!crossing)
+        {
+            crossing = true;
+            current.spectra++;
+            current.endNs = timeNs + spectrumNs;
+        }
+        if(snr > current.snrDb)
+        {
+            current.snrDb = snr;
+            current.peakDb = db[k];
+            current.peakBin = k;
+            current.dopplerHz = (k - bins / 2) * binHz - settings.carrierOffsetHz;
+        }
+    }
+
+    /*percentile tracking: up by step * p, down by step * (1 - p), bins with a crossing are held*/
+    const double up = settings.floorStepDb * settings.floorPercentile / 100;
+    const double down = settings.floorStepDb * (1 - settings.floorPercentile / 100);
+    for(int k = 0; k < bins; k++)
+    {
+        if(db[k] - floorDb[k] >= settings.thresholdDb)
+        {
+            continue;
+        }
+        floorDb[k] += db[k] > floorDb[k] ? up : -down;
+    }
+
+    if(open && !crossing)
+    {
+        return finish();
+    }
+    return false;
+}
+
+bool MeteorDetector::finish()
+{
+    if(!open)
+    {
+        return false;
+    }
+    open = false;
+    finished = current;
+    eventCount++;
+    return true;
+}
+
+void writeEventHeader(std::ostream& out)
+{
+    out << "start_ns,duration_s,doppler_hz,freq_mhz,snr_db,peak_dbfs_hz,spectra" << std::endl;
+}
+
+void writeEvent(std::ostream& out, const MeteorEvent& event, double centerFreq, double sampleRate, int bins)
+{
+    const double freqMHz = (centerFreq + (event.peakBin - bins / 2) * sampleRate / bins) / 1e6;
+    const std::streamsize precision = out.precision(10);
+    out << event.startNs << ',' << (event.endNs - event.startNs) / 1e9 << ',' << event.dopplerHz << ','
+        << freqMHz << ',' << event.snrDb << ',' << event.peakDb << ',' << event.spectra << std::endl;
+    out.precision(precision);
+}
@@ -0,0 +1,79 @@
+#ifndef _DETECTOR_H
+#define _DETECTOR_H
+
+#include <vector>
+#include <ostream>
+
+/*everything the meteor detector needs to know*/
+struct DetectorSettings
+{
+    double carrierOffsetHz = 0;     //radar carrier relative to the center frequency
+    double searchHz = 1000;         //echoes are looked for within +-searchHz of the carrier
+    double thresholdDb = 10;        //SNR over the noise floor that counts as a crossing
+    double floorPercentile = 50;    //percentile of every bin the noise floor tracks
+    double floorStepDb = 0.05;      //how far the floor may move per spectrum
+    int warmupSpectra = 20;         //floor is a plain mean over the first spectra, nothing is flagged
+    int guardBins = 2;              //CFAR cells skipped on each side of the cell under test
+    int referenceBins = 8;          //CFAR cells averaged on each side after the guard cells
+};
+
+/*one echo: consecutive spectra with a crossing in the search band*/
+struct MeteorEvent
+{
+    long long startNs = 0;
+    long long endNs = 0;
+    int peakBin = 0;            //bin of the strongest crossing, fftshift-ed
+    double dopplerHz = 0;       //peak bin relative to the carrier
+    double snrDb = 0;           //peak over the CFAR reference at that bin
+    double peakDb = 0;          //dBFS/Hz at the peak
+    int spectra = 0;            //spectra the event lasted
+};
+
+/*
+runs on the stream of averaged spectra (dB values, negative frequencies first like Psd).
+Noise floor of every bin follows a percentile of its own history: every spectrum moves it
+a fixed step up or down, so it costs O(bins) per spectrum and no history is stored.
+Bins above the threshold do not move their floor, an echo does not raise it.
+Cell under test is compared with the mean floor of its reference cells (CA-CFAR over the floor),
+only bins within the search band around the carrier are tested   */
+class MeteorDetector
+{
+public:
+    /*throws std::invalid_argument when the carrier is not within the spectrum*/
+    MeteorDetector(const DetectorSettings& settings, int bins, double sampleRate, double spectrumSeconds);
+
+    /*spectrum of the window starting at timeNs, true when an event has just ended*/
+    bool process(long long timeNs, const std::vector<double>& db);
+    /*end of the stream, true when an event was still open*/
+    bool finish();
+    /*the event process() or finish() reported*/
+    const MeteorEvent& event() const { return finished; }
+
+    long long spectra() const { return spectrumCount; }
+    long long events() const { return eventCount; }
+
+private:
+    DetectorSettings settings;
+    int bins;
+    double binHz;
+    long long spectrumNs;
+    int firstBin;
+    int lastBin;
+    int carrierBin;
+    std::vector<double> floorDb;
+    /*floor converted to power, then its running sum for the CFAR reference*/
+    std::vector<double> floorPower;
+    std::vector<double> floorSum;
+
+    long long spectrumCount = 0;
+    long long eventCount = 0;
+    bool open = false;
+    MeteorEvent current;
+    MeteorEvent finished;
+};
+
+/*event log, one CSV line per event*/
+void writeEventHeader(std::ostream& out);
+void writeEvent(std::ostream& out, const MeteorEvent& event, double centerFreq, double sampleRate, int bins);
+
+#endif
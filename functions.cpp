@@ -1,25 +1,38 @@
 #include <vector>
 #include <fstream>
 #include <numeric>
-#include <fftw3.h>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <csignal>
+#include <mutex>
+#include <iomanip>
+#include <sstream>
 #include <math.h>
 #include <stdexcept>
-#include <gnuplot-iostream.h>
-#include <SoapySDR/Device.hpp>
-#include <SoapySDR/Types.hpp>
-#include <SoapySDR/Formats.hpp>
+#include <pthread.h>
 #include "functions.h"
+#include "spectrum.h"
+#include "iqfile.h"
+#include "ringbuffer.h"
+#include "acquisition.h"
+#include "source.h"
+#include "plotsink.h"
+#include "waterfall.h"
+#include "detector.h"
+#include "channelizer.h"
+#include "cache.h"
+#include "sweep.h"
+#include "settings.h"
+#include "recorder.h"
 
 const std::string getTimeString()
 {
-    time_t now = time(0);
-    tm* time = localtime(&now);
-
-    std::string currentTime = std::to_string(time->tm_hour) + std::to_string(time->tm_min) + 
-                            std::to_string(time->tm_sec) + "_" + std::to_string(time->tm_mday) + 
-                            std::to_string(time->tm_mon) + std::to_string(time->tm_year + 1900);
-
-    return currentTime;
+    return timeString(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count(), false);
 }
 
 bool isFilenameValid(const std::string& name)
@@ -66,394 +79,1535 @@ bool isIQextensionValid(const std::string& fileName)
     return isOK;
 }
 
-void saveSettingToFile(const arguments& arguments)
+/*set by Ctrl-C, stops live mode cleanly*/
+static std::atomic<bool> stopRequested{false};
+
+static void onInterrupt(int)
 {
-    std::fstream settingsFile;
-    settingsFile.open("settings.conf", std::ios::out | std::ios::trunc);
-    if(settingsFile.is_open())
+    stopRequested = true;
+}
+
+/*-I: the receiver (the one with `serial` when given), a replayed capture or the synthetic signal*/
+static std::unique_ptr<SampleSource> openSource(const arguments& arguments, const std::string& serial = "")
+{
+    if(arguments.source == "soapy")
+    {
+        return std::unique_ptr<SampleSource>(new SoapySource(arguments.freq, arguments.sampleRate,
+                                                             arguments.gain, arguments.bandwidth, serial));
+    }
+    std::cout << "No receiver, ";
+    if(arguments.replaySpeed > 0)
     {
-        /*write default settings*/
-        settingsFile << arguments.sampleRate << std::endl;
-        settingsFile << arguments.freq << std::endl;
-        settingsFile << arguments.gain << std::endl;
-        settingsFile << arguments.bandwidth << std::endl;
-        settingsFile << arguments.blockLenght << std::endl;
-        settingsFile << arguments.numberOfBlocks << std::endl;
-        settingsFile.close();
-        std::cout << "Done." <<std::endl;
-    }   
+        std::cout << "samples are delivered at " << arguments.replaySpeed << " times real time" << std::endl;
+    }
     else
     {
-        throw std::runtime_error{"Saving to settings.conf failed >_<"};
-    }    
+        std::cout << "samples are delivered as fast as they are taken" << std::endl;
+    }
+    if(arguments.source == "synthetic")
+    {
+        SyntheticSettings settings;
+        settings.sampleRate = arguments.sampleRate;
+        /*every named synthetic receiver hears its own noise and echoes*/
+        settings.seed += serial.empty() ? 0 : hashString(serial);
+        std::cout << "Synthetic tones, noise and meteor echoes at " << settings.sampleRate << " samples/s" << std::endl;
+        return std::unique_ptr<SampleSource>(new SyntheticSource(arguments.freq, settings, arguments.replaySpeed));
+    }
+    const bool loop = arguments.source.compare(0, 5, "loop:") == 0;
+    const std::string fileName = loop ? arguments.source.substr(5) : arguments.source;
+    if(fileName == arguments.fileName)
+    {
+        throw std::runtime_error{"Cannot replay " + fileName + " into itself"};
+    }
+    std::unique_ptr<SampleSource> source(new FileSource(fileName, arguments.replaySpeed, loop));
+    std::cout << "Replaying " << fileName << (loop ? " over and over" : "") << ", " << source->freq() << " Hz, "
+              << source->sampleRate() << " samples/s" << std::endl;
+    return source;
 }
 
-void measure(const arguments& arguments)
+static IqHeader headerFromArguments(const arguments& arguments)
 {
-    /*get all sdr devices*/
-    SoapySDR::KwargsList results = SoapySDR::Device::enumerate();
-    SoapySDR::Kwargs::iterator itr;
+    IqHeader header;
+    header.freq = arguments.freq;
+    header.sampleRate = arguments.sampleRate;
+    header.numberOfBlocks = arguments.numberOfBlocks;
+    header.blockLenght = arguments.blockLenght;
+    header.gain = arguments.gain;
+    header.bandwidth = arguments.bandwidth;
+    header.codec = arguments.compress ? IqCodec::rice : IqCodec::none;
+    return header;
+}
 
-    /*show the results*/
-    if(results.empty())
+static WelchSettings welchSettings(const arguments& arguments, int lenght)
+{
+    WelchSettings welch;
+    welch.lenght = lenght;
+    welch.overlapPercent = arguments.overlap;
+    welch.window = windowFromName(arguments.window);
+    welch.removeDc = arguments.removeDc;
+    welch.batchSegments = std::max(1, arguments.batchBlocks);
+    welch.threads = arguments.threads;
+    welch.flags = plannerFlags(arguments.planner);
+    return welch;
+}
+
+/*-d and -c: a channelizer in front of everything else, none when neither is given*/
+static std::unique_ptr<Channelizer> channelizerFor(const arguments& arguments, double sampleRate)
+{
+    if(arguments.channelRate <= 0 && arguments.channelShift == 0)
     {
-        throw std::runtime_error{"No devices connected"};
+        return nullptr;
     }
+    std::unique_ptr<Channelizer> channelizer(new Channelizer(sampleRate, arguments.channelShift,
+                                                             decimationFor(sampleRate, arguments.channelRate)));
+    std::cout << "Channel " << arguments.channelShift << " Hz from the center, decimated by " << channelizer->decimation()
+              << " to " << channelizer->outputRate() << " samples/s, " << channelizer->taps() << " taps, "
+              << channelizer->gainDb() << " dB of gain" << std::endl;
+    return channelizer;
+}
 
-    std::cout << "\nStarting measurent..." << std::endl;
-    std::cout << "You can find the results in " << arguments.fileName << " file" << std::endl;  
-    /*create a file*/
-    std::fstream outputFile;
-    outputFile.open(arguments.fileName, std::ios::trunc | std::ios::binary | std::ios::out);
+/*-E is given from the tuned frequency, the channelizer moves the center*/
+static DetectorSettings detectorSettings(const arguments& arguments, const Channelizer* channelizer)
+{
+    DetectorSettings detector;
+    detector.carrierOffsetHz = arguments.carrierOffset - (channelizer ? channelizer->shift() : 0);
+    detector.searchHz = arguments.detectSpan;
+    detector.thresholdDb = arguments.detectThreshold;
+    return detector;
+}
 
-    /*write frequency, sample rate amount of blocks and its size*/
-    outputFile.write(reinterpret_cast<const char*>(&arguments.freq), sizeof(arguments.freq));
-    outputFile.write(reinterpret_cast<const char*>(&arguments.sampleRate), sizeof(arguments.sampleRate));
-    outputFile.write(reinterpret_cast<const char*>(&arguments.numberOfBlocks), sizeof(arguments.numberOfBlocks));
-    outputFile.write(reinterpret_cast<const char*>(&arguments.blockLenght), sizeof(arguments.blockLenght));
-    outputFile.write(reinterpret_cast<const char*>(&arguments.gain), sizeof(arguments.gain));
-    outputFile.write(reinterpret_cast<const char*>(&arguments.bandwidth), sizeof(arguments.bandwidth));
+/*FILE.iq -> FILE.events.csv, events of later runs are appended*/
+static std::string openEventLog(const std::string& fileName, std::ofstream& log)
+{
+    std::string logName = fileName;
+    if(logName.size() > 3 && logName.compare(logName.size() - 3, 3, ".iq") == 0)
+    {
+        logName.resize(logName.size() - 3);
+    }
+    logName += ".events.csv";
+    log.open(logName, std::ios::app);
+    if(!log.is_open())
+    {
+        throw std::runtime_error{"Cannot create " + logName};
+    }
+    if(log.tellp() == 0)
+    {
+        writeEventHeader(log);
+    }
+    return logName;
+}
+
+static bool hasExtension(const std::string& fileName, const std::string& extension)
+{
+    return fileName.size() > extension.size() &&
+           fileName.compare(fileName.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+/*
+one receiver's RX thread, ring and writer thread. The RX thread reads blocks
+into a preallocated ring, the writer thread drains it to disk, so a disk stall
+does not delay the next read of the receiver */
+struct Capture
+{
+    std::string fileName;
+    std::unique_ptr<SampleSource> source;
+    std::unique_ptr<Channelizer> channelizer;
+    IqHeader header;                    //of the received counts, before the channelizer
+    std::unique_ptr<BlockSink> output;  //one IqWriter, or a SegmentRecorder with -r
+    std::unique_ptr<DecimatedBlocks> decimated;
+    std::unique_ptr<SpscRing<RxBlock>> ring;
+    std::unique_ptr<ContinuityChecker> continuity;
+    AcquisitionStats stats;
+    size_t highWaterMark = 0;
+    std::atomic<bool> rxDone{false};
+    std::exception_ptr rxError;
+    std::exception_ptr writerError;
+    std::thread rx;
+    std::thread writer;
+};
+
+/*-r: measure records until Ctrl-C, into a new file every so many seconds or bytes*/
+static bool isSegmented(const arguments& arguments)
+{
+    return arguments.segmentSeconds > 0 || arguments.segmentBytes > 0;
+}
+
+/*file, channelizer and ring of a capture from `source`, nothing runs yet*/
+static void prepareCapture(Capture& capture, const arguments& arguments, std::unique_ptr<SampleSource> source,
+                           const std::string& fileName)
+{
+    capture.fileName = fileName;
+    capture.source = std::move(source);
+    /*the file gets the decimated counts when there is a channelizer*/
+    capture.channelizer = channelizerFor(arguments, capture.source->sampleRate());
+    capture.header = headerFromArguments(arguments);
+    capture.header.freq = capture.source->freq();
+    capture.header.sampleRate = capture.source->sampleRate();
+    const IqHeader saved = capture.channelizer ? decimatedHeader(capture.header, *capture.channelizer) : capture.header;
+    if(isSegmented(arguments))
+    {
+        /*FILE.iq -> FILE_YYYYMMDD_HHMMSSZ.iq, ...*/
+        SegmentSettings segments;
+        segments.seconds = arguments.segmentSeconds;
+        segments.bytes = arguments.segmentBytes;
+        segments.budgetBytes = arguments.diskBudget;
+        segments.dropCache = arguments.dropCache;
+        capture.output.reset(new SegmentRecorder(hasExtension(fileName, ".iq") ? fileName.substr(0, fileName.size() - 3) : fileName,
+                                                 saved, segments));
+    }
+    else
+    {
+        IqWriteOptions options;
+        options.preallocateBytes = iqFileBytes(saved, saved.numberOfBlocks);
+        options.dropCache = arguments.dropCache;
+        capture.output.reset(new IqWriter(fileName, saved, options));
+    }
+    if(capture.channelizer)
+    {
+        BlockSink* output = capture.output.get();
+        capture.decimated.reset(new DecimatedBlocks(*capture.channelizer, arguments.blockLenght,
+            [output](const std::complex<int8_t>* samples, long long timeNs, int flags)
+            {
+                output->write(samples, timeNs, flags);
+            }));
+    }
+    RxBlock prototype;
+    prototype.samples.resize(arguments.blockLenght);
+    capture.ring.reset(new SpscRing<RxBlock>(arguments.ringBlocks, prototype));
+    capture.continuity.reset(new ContinuityChecker(capture.source->sampleRate(), arguments.blockLenght));
+}
+
+/*keep `thread` on core `cpu`, only a warning when the system does not allow it*/
+static void pinThread(std::thread& thread, int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % std::max(1u, std::thread::hardware_concurrency()), &set);
+    if(pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) != 0)
+    {
+        std::cout << "Warning: cannot pin a thread to core " << cpu << std::endl;
+    }
+}
 
-    for( int i = 0; i < results.size(); ++i)
+/*run the RX and writer threads, pinned to the cores `rxCpu` and `writerCpu` unless they are negative*/
+static void startCapture(Capture& capture, const arguments& arguments, int rxCpu = -1, int writerCpu = -1)
+{
+    capture.rx = std::thread([&capture, &arguments]()
+    {
+        try
+        {
+            receiveBlocks(*capture.source, *capture.ring, arguments.blockLenght,
+                          isSegmented(arguments) ? -1 : arguments.numberOfBlocks,
+                          stopRequested, capture.stats, capture.highWaterMark);
+        }
+        catch(...)
+        {
+            capture.rxError = std::current_exception();
+        }
+        capture.rxDone = true;
+    });
+    capture.writer = std::thread([&capture]()
     {
-        std::cout << "Found device #" << i << " ";
-        for( itr = results[i].begin(); itr != results[i].end(); ++itr)
+        SpscRing<RxBlock>& ring = *capture.ring;
+        try
+        {
+            while(true)
+            {
+                RxBlock* buff = ring.front();
+                if(buff == nullptr)
+                {
+                    if(capture.rxDone && ring.occupancy() == 0)
+                    {
+                        break;
+                    }
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                    continue;
+                }
+                capture.continuity->check(*buff, capture.stats);
+                if(capture.decimated)
+                {
+                    capture.decimated->push(buff->samples.data(), buff->samples.size(), buff->timeNs, buff->flags);
+                }
+                else
+                {
+                    capture.output->write(buff->samples.data(), buff->timeNs, buff->flags);
+                }
+                ring.pop();
+            }
+        }
+        catch(...)
         {
-            std::cout << itr->first.c_str() << " = " << itr->second.c_str() <<std::endl;
+            /*nothing more can be saved, the receiver stops too and what was written is closed*/
+            capture.writerError = std::current_exception();
+            stopRequested = true;
         }
-        std::cout << std::endl;
+    });
+    if(rxCpu >= 0)
+    {
+        pinThread(capture.rx, rxCpu);
     }
-
-    /*get only one device*/
-    SoapySDR::Kwargs arg = results[0];
-    SoapySDR::Device* device = SoapySDR::Device::make(arg);
-    if(device == nullptr || device == NULL)
+    if(writerCpu >= 0)
     {
-        throw std::runtime_error{"Cannot make a device"};
+        pinThread(capture.writer, writerCpu);
     }
+}
 
-    /*query device info*/
-    std::vector<std::string> str_list;
+/*wait for the threads, close the file and release the receiver*/
+static void finishCapture(Capture& capture)
+{
+    capture.rx.join();
+    capture.writer.join();
+    capture.output->close();
+    capture.source.reset();
+}
+
+/*samples of the blocks that were saved*/
+static double captureSamples(const Capture& capture)
+{
+    return static_cast<double>(capture.output->blocks()) * capture.header.blockLenght;
+}
 
-    /*antennas*/
-    str_list = device->listAntennas(SOAPY_SDR_RX, channel);
-    std::cout << "RX antennas: ";
-    for(int i = 0; i < str_list.size(); ++i)
+static void reportCapture(const Capture& capture, const arguments& arguments, double seconds)
+{
+    capture.stats.report(std::cout);
+    std::cout << "Ring high-water mark: " << capture.highWaterMark << " of " << capture.ring->capacity() << " blocks" << std::endl;
+    const double samples = captureSamples(capture);
+    std::cout << "Throughput: " << capture.output->bytes() / seconds / 1e6 << " MB/s, "
+              << samples / seconds << " samples/s, "
+              << capture.stats.samplesReceived / seconds / capture.header.sampleRate << " times real time" << std::endl;
+    if(arguments.compress && capture.output->bytes() > 0)
+    {
+        std::cout << "Coded " << samples * sizeof(std::complex<int8_t>) / capture.output->bytes()
+                  << " times smaller than the counts" << std::endl;
+    }
+    if(capture.channelizer && capture.channelizer->clipped() > 0)
     {
-        std::cout << str_list[i].c_str() << ", ";
+        std::cout << "Warning: " << capture.channelizer->clipped() << " decimated counts were clipped" << std::endl;
     }
-    std::cout << std::endl;
+}
 
-    /*gains*/
-    str_list = device->listGains(SOAPY_SDR_RX, channel);
-    std::cout << "RX gains: ";
-    for(int i = 0; i < str_list.size(); ++i)
+/*the first error of a capture, once it is finished*/
+static void checkCapture(const Capture& capture)
+{
+    if(capture.rxError)
     {
-        std::cout << str_list[i].c_str() << ", ";
+        std::rethrow_exception(capture.rxError);
     }
-    std::cout << std::endl;
+    if(capture.writerError)
+    {
+        std::rethrow_exception(capture.writerError);
+    }
+    if(capture.output->failed())
+    {
+        throw std::runtime_error{"Writing to " + capture.fileName + " failed"};
+    }
+}
 
-    /*frequency ranges*/
-    SoapySDR::RangeList ranges = device->getFrequencyRange(SOAPY_SDR_RX, channel);
-    std::cout << "RX ranges: ";
-    for(int i = 0; i < ranges.size(); ++i)
+/*-r captures stop on Ctrl-C instead of after -n blocks*/
+static void catchInterrupt(const arguments& arguments)
+{
+    stopRequested = false;
+    std::signal(SIGINT, onInterrupt);
+    std::cout << "Recording a new segment every ";
+    if(arguments.segmentBytes > 0)
+    {
+        std::cout << formatBytes(arguments.segmentBytes);
+    }
+    else
+    {
+        std::cout << arguments.segmentSeconds << " s";
+    }
+    if(arguments.diskBudget > 0)
     {
-        std::cout << ranges[i].minimum() << "->" << ranges[i].maximum();
+        std::cout << " within " << formatBytes(arguments.diskBudget);
     }
-    std::cout << std::endl;
+    std::cout << ", press Ctrl-C to stop" << std::endl;
+}
 
-    /*set the settings*/
-    device->setSampleRate(SOAPY_SDR_RX, channel, arguments.sampleRate);
-    device->setFrequency(SOAPY_SDR_RX, channel, arguments.freq);
-    device->setGain(SOAPY_SDR_RX, channel, arguments.gain);
-    device->setBandwidth(SOAPY_SDR_RX, channel, arguments.bandwidth);
+void measure(const arguments& arguments)
+{
+    std::cout << "\nStarting measurent..." << std::endl;
+    std::cout << "You can find the results in " << arguments.fileName << " file" << std::endl;  
+    Capture capture;
+    prepareCapture(capture, arguments, openSource(arguments), arguments.fileName);
 
-    /*setup a stream*/
-    SoapySDR::Stream* rx_stream = device->setupStream(SOAPY_SDR_RX, SOAPY_SDR_CS8);
-    if(rx_stream == NULL || rx_stream == nullptr)
+    if(isSegmented(arguments))
     {
-        SoapySDR::Device::unmake(device);
-        throw std::runtime_error{"Cannot create a stream"};
+        catchInterrupt(arguments);
     }
-    device->activateStream(rx_stream, 0, 0, 0);
+    const auto startTime = std::chrono::steady_clock::now();
+    startCapture(capture, arguments);
+    finishCapture(capture);
+    std::signal(SIGINT, SIG_DFL);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    reportCapture(capture, arguments, seconds);
+    checkCapture(capture);
+    std::cout << "\nDone." << std::endl;
+}
 
-    std::complex<char> buff[arguments.blockLenght];
-    for(int i = 0; i < arguments.numberOfBlocks; ++i)
+/*the receivers of -M get this long to be opened before their shared start*/
+constexpr long long sharedStartDelayNs = 500000000;
+
+void measureDevices(const arguments& arguments)
+{
+    std::vector<std::string> serials;
+    std::stringstream list(arguments.deviceSerials);
+    for(std::string serial; std::getline(list, serial, ',');)
     {
-        void* buffs[] = {buff};
-        int flags;
-        long long time_ns;
-        int ret = device->readStream(rx_stream, buffs, arguments.blockLenght, flags, time_ns, 1000000);
-    
-        for(int j = 0; j < arguments.blockLenght; j++)
+        if(!serial.empty())
+        {
+            serials.push_back(serial);
+        }
+    }
+    if(serials.empty())
+    {
+        throw std::runtime_error{"-M needs at least one serial number"};
+    }
+    if(arguments.source != "soapy" && arguments.source != "synthetic")
+    {
+        throw std::runtime_error{"-M opens receivers, a replayed file cannot be one of them"};
+    }
+
+    /*one run, one time string: FILE.iq -> FILE_SERIAL.iq for every receiver*/
+    std::string base = arguments.fileName;
+    if(hasExtension(base, ".iq"))
+    {
+        base.resize(base.size() - 3);
+    }
+    std::cout << "\nStarting measurent with " << serials.size() << " receivers..." << std::endl;
+    std::vector<std::unique_ptr<Capture>> captures;
+    for(const std::string& serial : serials)
+    {
+        if(!isFilenameValid(serial))
         {
-            outputFile << buff[j].real() << buff[j].imag();
+            throw std::runtime_error{"Serial number " + serial + " cannot be part of a file name"};
         }
+        captures.emplace_back(new Capture);
+        const std::string fileName = base + "_" + serial + ".iq";
+        prepareCapture(*captures.back(), arguments, openSource(arguments, serial), fileName);
+        std::cout << "Receiver " << serial << " is saved to " << fileName << std::endl;
+    }
+
+    /*
+    every receiver is opened before any starts. They all drop what they queued
+    and start at one host time, which their time stamps count from. Every
+    receiver gets one core for its RX thread and the next for its writer */
+    const long long startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count() + sharedStartDelayNs;
+    for(std::unique_ptr<Capture>& capture : captures)
+    {
+        capture->source.reset(new AlignedSource(std::move(capture->source), startNs));
+    }
+    std::cout << "Shared start at " << startNs << " ns since the epoch" << std::endl;
+    if(isSegmented(arguments))
+    {
+        catchInterrupt(arguments);
+    }
+    const auto startTime = std::chrono::steady_clock::now() + std::chrono::nanoseconds(sharedStartDelayNs);
+    for(size_t i = 0; i < captures.size(); i++)
+    {
+        startCapture(*captures[i], arguments, static_cast<int>(2 * i), static_cast<int>(2 * i + 1));
+    }
+    for(std::unique_ptr<Capture>& capture : captures)
+    {
+        finishCapture(*capture);
     }
-    outputFile.close();
+    std::signal(SIGINT, SIG_DFL);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
 
-    device->deactivateStream(rx_stream, 0, 0);
-    device->closeStream(rx_stream);
+    AcquisitionStats total;
+    double totalBytes = 0;
+    double totalSamples = 0;
+    for(size_t i = 0; i < captures.size(); i++)
+    {
+        std::cout << "\nReceiver " << serials[i] << ", " << captures[i]->fileName << ":" << std::endl;
+        reportCapture(*captures[i], arguments, seconds);
+        total.add(captures[i]->stats);
+        totalBytes += captures[i]->output->bytes();
+        totalSamples += captureSamples(*captures[i]);
+    }
+    std::cout << "\nAll " << captures.size() << " receivers: " << totalBytes / seconds / 1e6 << " MB/s, "
+              << totalSamples / seconds << " samples/s" << std::endl;
+    std::cout << "Overflows: " << total.overflows << ", ring overruns: " << total.ringOverruns
+              << " blocks, discontinuities: " << total.discontinuities << ", dropped samples: " << total.droppedSamples << std::endl;
 
-    SoapySDR::Device::unmake(device);
+    for(std::unique_ptr<Capture>& capture : captures)
+    {
+        checkCapture(*capture);
+    }
     std::cout << "\nDone." << std::endl;
 }
 
-void plot(const arguments& arguments)
+/*live display refreshes at most this many times a second*/
+constexpr double maxPlotRate = 5;
+
+void live(const arguments& arguments)
 {
-    std::vector<char> ic;
-    std::vector<char> qc;
-    double currentSampleRate = 0;
-    double currentFrequency = 0;
-    int currentBlockLenght = 0;
-    int currentNumberOfBlocks = 0;
-    int currentGain = 0;
-    int currentBandwidth = 0;
+    const int N = arguments.blockLenght;
+    const long long window = std::max(1, arguments.liveWindow);
+    const int batchBlocks = static_cast<int>(std::min<long long>(std::max(1, arguments.batchBlocks), window));
+    WelchSettings welch = welchSettings(arguments, N);
+
+    std::unique_ptr<SampleSource> source = openSource(arguments);
 
-    /*open file with iq counts*/
-    std::fstream iqs;
-    iqs.open(arguments.fileName, std::ios::in | std::ios::binary);
-    if(!iqs.is_open())
+    /*with a channelizer everything after the ring sees the decimated channel*/
+    std::unique_ptr<Channelizer> channelizer = channelizerFor(arguments, source->sampleRate());
+    IqHeader header = headerFromArguments(arguments);
+    header.freq = source->freq();
+    header.sampleRate = source->sampleRate();
+    if(channelizer)
     {
-        throw std::runtime_error{"Cannot open the " + arguments.fileName + " Did you write its name correctly?"};
+        header = decimatedHeader(header, *channelizer);
     }
 
-    /*read file*/
-    int i = 0;
-    char temp;
-    while(true)
+    /*iq counts are recorded alongside only when -o was given a name*/
+    std::unique_ptr<IqWriter> recording;
+    if(arguments.customFileName && !arguments.fileName.empty())
+    {
+        recording.reset(new IqWriter(arguments.fileName, header));
+        std::cout << "Recording iq counts to " << arguments.fileName << std::endl;
+    }
+
+    /*before the receiver thread starts, a bad -E or -H stops the run here*/
+    std::unique_ptr<MeteorDetector> detector;
+    std::ofstream eventLog;
+    if(arguments.detect)
+    {
+        detector.reset(new MeteorDetector(detectorSettings(arguments, channelizer.get()), N, header.sampleRate,
+                                          window * N / header.sampleRate));
+        const std::string logName = openEventLog(recording ? arguments.fileName : getTimeString() + ".iq", eventLog);
+        std::cout << "Meteor echoes are logged to " << logName << std::endl;
+    }
+
+    RxBlock prototype;
+    prototype.samples.resize(N);
+    SpscRing<RxBlock> ring(arguments.ringBlocks, prototype);
+    std::atomic<bool> rxDone{false};
+    std::exception_ptr rxError;
+    AcquisitionStats stats;
+    size_t highWaterMark = 0;
+
+    /*
+    DSP stage: blocks are gathered into a contiguous batch for the averager,
+    a spectrum is emitted every `window` blocks, so latency is one window */
+    SpectrumAverager averager(welch);
+    PlotSink plotSink(maxPlotRate, "Live spectrum");
+    long long windowTimeNs = 0;
+    std::vector<std::complex<int8_t>> batch(static_cast<size_t>(batchBlocks) * N);
+    int batchFill = 0;
+    long long windowFill = 0;
+    long long spectra = 0;
+    auto onBlock = [&](const std::complex<int8_t>* samples, long long timeNs, int flags)
     {
-        if(i == 0)
+        if(recording)
         {
-            /*read settings*/
-            iqs.read(reinterpret_cast<char*>(&currentFrequency), sizeof(double));
-            iqs.read(reinterpret_cast<char*>(&currentSampleRate), sizeof(double));
-            iqs.read(reinterpret_cast<char*>(&currentNumberOfBlocks), sizeof(int));
-            iqs.read(reinterpret_cast<char*>(&currentBlockLenght), sizeof(int));
-            iqs.read(reinterpret_cast<char*>(&currentGain), sizeof(currentGain));
-            iqs.read(reinterpret_cast<char*>(&currentBandwidth), sizeof(currentBandwidth));
-            i = 1;  /*to make i even and non-zero for next iteration*/
+            recording->write(samples, timeNs, flags);
         }
-        else if((i % 2) == 0)   /*if i is even it's ic*/
+        if(windowFill == 0)
         {
-            iqs.read(&temp, sizeof(char));
-            if(iqs.eof())
+            /*device time when there is one, the host clock otherwise*/
+            windowTimeNs = (flags & blockHasTime) ? timeNs :
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+        std::copy(samples, samples + N, batch.begin() + static_cast<size_t>(batchFill) * N);
+        batchFill++;
+        windowFill++;
+
+        if(batchFill == batchBlocks || windowFill == window)
+        {
+            averager.process(batch.data(), static_cast<size_t>(batchFill) * N);
+            batchFill = 0;
+        }
+        if(windowFill == window)
+        {
+            Psd psd = averager.psd(header.freq, header.sampleRate);
+            size_t peak = std::max_element(psd.dbfsPerHz.begin(), psd.dbfsPerHz.end()) - psd.dbfsPerHz.begin();
+            std::cout << "Spectrum #" << ++spectra << ": peak " << psd.dbfsPerHz[peak] << " dBFS/Hz at "
+                      << psd.freqMHz[peak] << " MHz" << std::endl;
+            plotSink.submit(psd.freqMHz, psd.dbfsPerHz);
+            if(detector && detector->process(windowTimeNs, psd.dbfsPerHz))
             {
-                break;
+                const MeteorEvent& event = detector->event();
+                writeEvent(eventLog, event, header.freq, header.sampleRate, N);
+                std::cout << "Meteor echo: Doppler " << event.dopplerHz << " Hz, SNR " << event.snrDb << " dB, "
+                          << (event.endNs - event.startNs) / 1e9 << " s" << std::endl;
             }
-            ic.emplace_back(temp);
+            averager.reset();
+            windowFill = 0;
+        }
+    };
+    std::unique_ptr<DecimatedBlocks> decimated;
+    if(channelizer)
+    {
+        decimated.reset(new DecimatedBlocks(*channelizer, N, onBlock));
+    }
+
+    stopRequested = false;
+    std::signal(SIGINT, onInterrupt);
+    std::cout << "\nLive spectrum every " << window << " blocks, press Ctrl-C to stop" << std::endl;
+
+    std::thread rx([&]()
+    {
+        try
+        {
+            receiveBlocks(*source, ring, N, -1, stopRequested, stats, highWaterMark);
         }
-        else /*if i is odd it's qc*/
+        catch(...)
         {
-            iqs.read(&temp, sizeof(char));
-            if(iqs.eof())
+            rxError = std::current_exception();
+        }
+        rxDone = true;
+    });
+
+    ContinuityChecker continuity(source->sampleRate(), N);
+    try
+    {
+        while(true)
+        {
+            RxBlock* buff = ring.front();
+            if(buff == nullptr)
             {
-                break;
+                if(rxDone && ring.occupancy() == 0)
+                {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            continuity.check(*buff, stats);
+            if(decimated)
+            {
+                decimated->push(buff->samples.data(), buff->samples.size(), buff->timeNs, buff->flags);
             }
-            qc.emplace_back(temp);
+            else
+            {
+                onBlock(buff->samples.data(), buff->timeNs, buff->flags);
+            }
+            ring.pop();
         }
-        i++;
     }
-    std::cout << "current frequency: " << currentFrequency << std::endl;
-    std::cout << "current sample rate: " << currentSampleRate << std::endl;
-    std::cout << "current block lenght: " << currentBlockLenght << std::endl;
-    std::cout << "current numbers of blocks: " << currentNumberOfBlocks << std::endl;
-    std::cout << "current gain: " << currentGain << std::endl;
-    std::cout << "current bandwidth " << currentBandwidth << std::endl;
+    catch(...)
+    {
+        /*the receiver stops too and the blocks recorded so far get their index*/
+        stopRequested = true;
+        rx.join();
+        std::signal(SIGINT, SIG_DFL);
+        if(recording)
+        {
+            recording->close();
+        }
+        throw;
+    }
+    rx.join();
+    std::signal(SIGINT, SIG_DFL);
+    if(detector)
+    {
+        if(detector->finish())
+        {
+            writeEvent(eventLog, detector->event(), header.freq, header.sampleRate, N);
+        }
+        std::cout << "Meteor echoes: " << detector->events() << " in " << detector->spectra() << " spectra" << std::endl;
+    }
 
-    /*size of array must to be power of 2*/
-    ic.resize(currentBlockLenght * currentNumberOfBlocks);
-    qc.resize(currentBlockLenght * currentNumberOfBlocks);
+    if(recording)
+    {
+        recording->close();
+    }
+    stats.report(std::cout);
+    std::cout << "Ring high-water mark: " << highWaterMark << " of " << ring.capacity() << " blocks" << std::endl;
+    std::cout << "Spectra shown: " << plotSink.framesShown() << ", skipped by the display: " << plotSink.framesSkipped() << std::endl;
 
-    /*create complex numbers*/
-    const int REAL = 0; 
-    const int IMAG = 1;
-    const int N = currentBlockLenght;
-    fftw_complex* inputFFTarray = (fftw_complex*)fftw_malloc(N * sizeof(fftw_complex));
-    fftw_complex* outputFFTarray = (fftw_complex*)fftw_malloc(N * sizeof(fftw_complex));
-    fftw_plan plan;
-    std::vector<fftw_complex>* complexAmplitudesSum = new std::vector<fftw_complex>(currentBlockLenght);
+    source.reset();
+    if(rxError)
+    {
+        std::rethrow_exception(rxError);
+    }
+    if(recording && recording->failed())
+    {
+        throw std::runtime_error{"Writing to " + arguments.fileName + " failed"};
+    }
+    std::cout << "\nDone." << std::endl;
+}
+
+void sweep(const arguments& arguments)
+{
+    std::unique_ptr<SampleSource> source = openSource(arguments);
+    const double rate = source->sampleRate();
+    const SweepPlan plan = sweepPlan(arguments.sweepSpec, rate);
+    const int N = arguments.blockLenght;
+    const long long stepBlocks = std::max(1, arguments.numberOfBlocks);
+    const long long settleBlocks = static_cast<long long>(std::ceil(arguments.settleMs / 1e3 * rate / N));
+    std::cout << "\nSweeping " << plan.lowHz / 1e6 << " to " << plan.highHz / 1e6 << " MHz in " << plan.centers.size()
+              << " steps of " << stepBlocks << " blocks, " << settleBlocks << " blocks dropped after every retune" << std::endl;
+
+    WelchSettings welch = welchSettings(arguments, N);
+    SpectrumAverager averager(welch);
+    SweepStitcher stitcher(plan, rate);
 
-    for(int i = 0; i < currentNumberOfBlocks; i++)
+    /*
+    RX thread retunes, drops the settling samples and captures a whole step into a
+    slot of a two step ring, while this thread averages the step before. So the FFT
+    of step k runs during the capture of step k+1 and a retune waits only when
+    the averaging is slower than the capture */
+    RxBlock prototype;
+    prototype.samples.resize(static_cast<size_t>(stepBlocks) * N);
+    SpscRing<RxBlock> ring(2, prototype);
+    std::atomic<bool> rxDone{false};
+    std::exception_ptr rxError;
+    AcquisitionStats stats;
+    double tuneSeconds = 0;
+    stopRequested = false;
+    std::signal(SIGINT, onInterrupt);
+
+    const auto startTime = std::chrono::steady_clock::now();
+    std::thread rx([&]()
     {
-        /*fill input array*/
-        for(int j = 0; j < currentBlockLenght; j++)
+        try
+        {
+            RxBlock settling;
+            settling.samples.resize(N);
+            for(size_t k = 0; k < plan.centers.size() && !stopRequested; k++)
+            {
+                RxBlock* slot;
+                while((slot = ring.acquire()) == nullptr && !stopRequested)
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+                if(slot == nullptr)
+                {
+                    break;
+                }
+                const auto tuneStart = std::chrono::steady_clock::now();
+                source->tune(plan.centers[k]);
+                for(long long b = 0; b < settleBlocks && !stopRequested; b++)
+                {
+                    source->read(settling, stats);
+                }
+                tuneSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - tuneStart).count();
+                if(stopRequested || !source->read(*slot, stats))
+                {
+                    break;
+                }
+                ring.publish();
+            }
+        }
+        catch(...)
         {
-            inputFFTarray[j][REAL] = static_cast<double>(ic[i * currentBlockLenght + j]);
-            inputFFTarray[j][IMAG] = static_cast<double>(qc[i * currentBlockLenght + j]);
-            outputFFTarray[j][REAL] = 0;
-            outputFFTarray[j][IMAG] = 0;
+            rxError = std::current_exception();
         }
-        /*create plan and execute it*/
-        plan = fftw_plan_dft_1d(N, inputFFTarray, outputFFTarray, FFTW_FORWARD, FFTW_ESTIMATE);
-        fftw_execute(plan);
+        rxDone = true;
+    });
 
-        /*sum FFT result*/
-        for(int k = 0; k < currentBlockLenght; k++)
+    size_t steps = 0;
+    double dspSeconds = 0;
+    try
+    {
+        while(true)
         {
-            complexAmplitudesSum->at(k)[REAL] += pow(outputFFTarray[k][REAL], 2);
-            complexAmplitudesSum->at(k)[IMAG] += pow(outputFFTarray[k][IMAG], 2);
+            RxBlock* step = ring.front();
+            if(step == nullptr)
+            {
+                if(rxDone && ring.occupancy() == 0)
+                {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                continue;
+            }
+            const auto dspStart = std::chrono::steady_clock::now();
+            averager.reset();
+            averager.process(step->samples.data(), step->samples.size());
+            stitcher.add(steps, averager.psd(plan.centers[steps], rate));
+            dspSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - dspStart).count();
+            if(step->flags & blockAfterOverflow)
+            {
+                std::cout << "Warning: the receiver overflowed during the step at " << plan.centers[steps] / 1e6 << " MHz" << std::endl;
+            }
+            ring.pop();
+            steps++;
         }
     }
+    catch(...)
+    {
+        /*the receiver stops retuning before the error leaves the sweep*/
+        stopRequested = true;
+        rx.join();
+        std::signal(SIGINT, SIG_DFL);
+        throw;
+    }
+    rx.join();
+    std::signal(SIGINT, SIG_DFL);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    source.reset();
+    if(rxError)
+    {
+        std::rethrow_exception(rxError);
+    }
 
-    /*we don't need it anymore*/
-    ic.clear();
-    qc.clear();
-    fftw_destroy_plan(plan);
-    fftw_free(inputFFTarray);
-    fftw_free(outputFFTarray);
+    stats.report(std::cout);
+    const Psd wide = stitcher.result();
+    if(wide.freqMHz.empty())
+    {
+        throw std::runtime_error{"No step of the sweep was captured"};
+    }
+    /*span of the stitched bins, a sweep stopped by Ctrl-C counts what it covered*/
+    const double sweptHz = (wide.freqMHz.back() - wide.freqMHz.front()) * 1e6 + rate / N;
+    std::cout << "Swept " << sweptHz / 1e6 << " MHz in " << steps << " steps, " << seconds << " s: "
+              << sweptHz / 1e6 / seconds << " MHz/s" << std::endl;
+    std::cout << "Per step: retune and settling " << tuneSeconds / steps * 1e3 << " ms, capture "
+              << stepBlocks * N / rate * 1e3 << " ms, averaging " << dspSeconds / steps * 1e3 << " ms" << std::endl;
 
-    /*average FFT results*/
-    for(int i = 0; i < currentBlockLenght; i++)
+    const std::string csvName = arguments.customFileName && !arguments.fileName.empty() ? arguments.fileName :
+                                getTimeString() + "_sweep.csv";
+    std::ofstream csv(csvName, std::ios::trunc);
+    csv << "freq_mhz,dbfs_per_hz\n" << std::fixed;
+    for(size_t i = 0; i < wide.freqMHz.size(); i++)
     {
-        complexAmplitudesSum->at(i)[REAL] /= currentNumberOfBlocks * currentNumberOfBlocks;
-        complexAmplitudesSum->at(i)[IMAG] /= currentNumberOfBlocks * currentNumberOfBlocks;
+        csv << std::setprecision(6) << wide.freqMHz[i] << ',' << std::setprecision(2) << wide.dbfsPerHz[i] << '\n';
     }
-    
-    /*compute amplitudes*/
-    std::vector<double> amplitudes(currentBlockLenght);
-    for(int i = 0; i < currentBlockLenght; i++)
+    csv.close();
+    if(!csv)
     {
-        amplitudes[i] = sqrt(complexAmplitudesSum->at(i)[REAL] + complexAmplitudesSum->at(i)[IMAG]);
+        throw std::runtime_error{"Writing to " + csvName + " failed"};
     }
-    for(int i = 0; i < currentBlockLenght; i++)
+    std::cout << "Wide-band spectrum saved to " << csvName << std::endl;
+
+    PlotSink plotSink;
+    plotSink.submit(wide.freqMHz, wide.dbfsPerHz);
+    std::cout << "\nDone." << std::endl;
+}
+
+/*heatmaps larger than this are shrunk before they are sent to gnuplot*/
+constexpr long long maxWaterfallRows = 1024;
+constexpr int maxWaterfallColumns = 2048;
+
+/*
+show a .wf file as a heatmap. Neighbouring rows and bins are merged
+keeping the maximum, so a short echo stays visible however long the file is */
+static void plotWaterfall(const arguments& arguments)
+{
+    WaterfallReader reader(arguments.fileName);
+    const WaterfallHeader& header = reader.header();
+    std::cout << "current frequency: " << header.freq << std::endl;
+    std::cout << "current sample rate: " << header.sampleRate << std::endl;
+    std::cout << "current bins: " << header.bins << std::endl;
+    std::cout << "current rows: " << reader.rows() << ", " << header.rowSeconds << " s each" << std::endl;
+    if(reader.rows() == 0)
     {
-        amplitudes[i] = 20 * log10(amplitudes[i]);
+        throw std::runtime_error{arguments.fileName + " has no rows"};
     }
 
-    /*free memory*/
-    complexAmplitudesSum->clear();
-    delete complexAmplitudesSum;
+    const long long rowsPerLine = (reader.rows() + maxWaterfallRows - 1) / maxWaterfallRows;
+    const int binsPerColumn = (header.bins + maxWaterfallColumns - 1) / maxWaterfallColumns;
+    const long long lines = (reader.rows() + rowsPerLine - 1) / rowsPerLine;
+    const int columns = (header.bins + binsPerColumn - 1) / binsPerColumn;
+    std::vector<float> image(static_cast<size_t>(lines) * columns, -1e30f);
+    std::vector<float> db;
+    long long timeNs;
+    long long firstTimeNs = 0;
+    for(long long r = 0; reader.next(timeNs, db); r++)
+    {
+        if(r == 0)
+        {
+            firstTimeNs = timeNs;
+        }
+        float* line = image.data() + (r / rowsPerLine) * columns;
+        for(int k = 0; k < header.bins; k++)
+        {
+            line[k / binsPerColumn] = std::max(line[k / binsPerColumn], db[k]);
+        }
+    }
 
+    /*pixel centres: frequency of the first bin of a column, time of the first row of a line*/
+    const double dxMHz = header.sampleRate * binsPerColumn / header.bins / 1e6;
+    const double x0MHz = (header.freq - header.sampleRate / 2) / 1e6;
+    const double dySec = header.rowSeconds * rowsPerLine;
+    std::cout << "Rows start at " << firstTimeNs / 1e9 << " s" << std::endl;
     std::cout << "Now plotting..." <<std::endl;
     std::cout << "Please, wait..." <<std::endl;
-    
-    //now start plotting
+
     Gnuplot gp;
-    gp << "set nokey\n";
-    gp << "set logscale y\n";
-    gp << "set title 'Spectrum'\n";
-    gp << "set xrange[0:" << currentBlockLenght << "]\n";
-    gp << "set yrange[0:]\n";
-    gp << "plot '-' smooth acsplines\n";
-    gp.send(amplitudes);
+    /*MHz axis needs more than the default 6 digits*/
+    gp.precision(12);
+    gp << "set title 'Waterfall'\n";
+    gp << "set xlabel 'Frequency, MHz'\n";
+    gp << "set ylabel 'Time, s'\n";
+    gp << "set cblabel 'dBFS/Hz'\n";
+    gp << "set autoscale xfixmin\n";
+    gp << "set autoscale xfixmax\n";
+    gp << "set autoscale yfixmin\n";
+    gp << "set autoscale yfixmax\n";
+    gp << "plot '-' binary array=(" << columns << "," << lines << ") format='%float'"
+       << " dx=" << dxMHz << " dy=" << dySec << " origin=(" << x0MHz << ",0) with image\n";
+    gp.write(reinterpret_cast<const char*>(image.data()), image.size() * sizeof(float));
+    gp.flush();
 }
 
-int parse_opt(int key, char* arg, struct argp_state* state)
+/*-X: the decimated counts of a capture that is read again are saved as well*/
+static std::unique_ptr<IqWriter> decimatedCapture(const arguments& arguments, const IqHeader& header,
+                                                  const Channelizer* channelizer)
 {
-    struct arguments* arguments = reinterpret_cast<struct arguments*>(state->input);
-    std::string strArg;
-    if(arg != 0)
+    if(!channelizer || arguments.decimatedFileName.empty())
     {
-        strArg = arg;
+        return nullptr;
     }
-    switch (key)
+    std::cout << "Saving the decimated capture to " << arguments.decimatedFileName << std::endl;
+    IqHeader decimated = decimatedHeader(header, *channelizer);
+    decimated.codec = arguments.compress ? IqCodec::rice : IqCodec::none;
+    return std::unique_ptr<IqWriter>(new IqWriter(arguments.decimatedFileName, decimated));
+}
+
+static void closeDecimatedCapture(const arguments& arguments, IqWriter* saved)
+{
+    if(!saved)
     {
-    case 'o':
-        if(strArg.empty() || isFilenameValid(strArg))
-        {
-            arguments->fileName = strArg;
-            std::cout << "You can find the results in " << strArg << " file" << std::endl;
-            arguments->customFileName = true;
-        }
-        else
+        return;
+    }
+    saved->close();
+    if(saved->failed())
+    {
+        throw std::runtime_error{"Writing to " + arguments.decimatedFileName + " failed"};
+    }
+    std::cout << "Decimated blocks saved: " << saved->blocks() << std::endl;
+}
+
+/*
+-k: blocks [first, end) of the capture, found through the block index
+by time, so only that stretch of the file is ever read  */
+static void blockRange(const arguments& arguments, const IqFile& iqs, long long& first, long long& end)
+{
+    first = 0;
+    end = iqs.blocks();
+    if(arguments.rangeStart <= 0 && arguments.rangeSeconds <= 0)
+    {
+        return;
+    }
+    long long startNs = 0;
+    int flags;
+    iqs.blockTime(0, startNs, flags);
+    first = iqs.blockAt(startNs + static_cast<long long>(arguments.rangeStart * 1e9));
+    if(arguments.rangeSeconds > 0)
+    {
+        end = iqs.blockAt(startNs + static_cast<long long>((arguments.rangeStart + arguments.rangeSeconds) * 1e9));
+    }
+    std::cout << "Blocks " << first << " to " << end << " of " << iqs.blocks() << std::endl;
+}
+
+void spectrogram(const arguments& arguments)
+{
+    IqFile iqs(arguments.fileName);
+    const IqHeader& header = iqs.header();
+    const int N = header.blockLenght;
+    if(N <= 0)
+    {
+        throw std::runtime_error{arguments.fileName + " has invalid block lenght"};
+    }
+    long long firstBlock, endBlock;
+    blockRange(arguments, iqs, firstBlock, endBlock);
+    std::unique_ptr<Channelizer> channelizer = channelizerFor(arguments, header.sampleRate);
+    std::unique_ptr<IqWriter> saved = decimatedCapture(arguments, header, channelizer.get());
+    IqStream stream(iqs, channelizer.get(), saved.get(), firstBlock, endBlock, arguments.threads);
+
+    const long long rowBlocks = std::max(1, arguments.waterfallBlocks);
+    const size_t rowSamples = static_cast<size_t>(rowBlocks) * N;
+    const long long inputBlocksPerRow = rowBlocks * (channelizer ? channelizer->decimation() : 1);
+    if(endBlock - firstBlock < inputBlocksPerRow)
+    {
+        throw std::runtime_error{arguments.fileName + " holds fewer than " + std::to_string(inputBlocksPerRow) + " blocks"};
+    }
+
+    /*FILE.iq -> FILE.wf*/
+    std::string outputName = arguments.fileName;
+    if(hasExtension(outputName, ".iq"))
+    {
+        outputName.resize(outputName.size() - 3);
+    }
+    outputName += ".wf";
+
+    WaterfallHeader wfHeader;
+    wfHeader.format = waterfallFormatFromName(arguments.waterfallFormat);
+    wfHeader.bins = N;
+    wfHeader.freq = stream.freq();
+    wfHeader.sampleRate = stream.sampleRate();
+    wfHeader.rowSeconds = rowSamples / stream.sampleRate();
+    WaterfallWriter writer(outputName, wfHeader);
+    std::cout << "Spectrogram of about " << (endBlock - firstBlock) / inputBlocksPerRow << " rows, " << rowBlocks << " blocks ("
+              << wfHeader.rowSeconds << " s) each, appended to " << outputName << " after "
+              << writer.rowsBefore() << " rows" << std::endl;
+
+    /*
+    every row is a Welch estimate over its own blocks, rows are written as soon
+    as they are complete, so memory use does not depend on the capture lenght.
+    Rows are timed from the block index, or from the start of the capture without one */
+    SpectrumAverager averager(welchSettings(arguments, N));
+    std::unique_ptr<MeteorDetector> detector;
+    std::ofstream eventLog;
+    if(arguments.detect)
+    {
+        detector.reset(new MeteorDetector(detectorSettings(arguments, channelizer.get()), N, stream.sampleRate(),
+                                          wfHeader.rowSeconds));
+        std::cout << "Meteor echoes are logged to " << openEventLog(arguments.fileName, eventLog) << std::endl;
+    }
+    const std::complex<int8_t>* samples;
+    size_t count;
+    size_t rowFill = 0;
+    long long rowStart = 0;
+    while(stream.next(samples, count))
+    {
+        for(size_t done = 0; done < count;)
         {
-            std::cout << "Error in file naming. Default file name will be used" << std::endl;
+            const size_t take = std::min(count - done, rowSamples - rowFill);
+            averager.process(samples + done, take);
+            done += take;
+            rowFill += take;
+            if(rowFill == rowSamples)
+            {
+                const long long timeNs = stream.timeNs(rowStart);
+                const Psd psd = averager.psd(stream.freq(), stream.sampleRate());
+                writer.append(timeNs, psd.dbfsPerHz);
+                if(detector && detector->process(timeNs, psd.dbfsPerHz))
+                {
+                    writeEvent(eventLog, detector->event(), stream.freq(), stream.sampleRate(), N);
+                }
+                averager.reset();
+                rowStart += rowSamples;
+                rowFill = 0;
+            }
         }
-        break;
-    case 'p':
-        if(arg == 0)
+    }
+    writer.close();
+    closeDecimatedCapture(arguments, saved.get());
+    if(detector)
+    {
+        if(detector->finish())
         {
-            argp_failure(state, 1, 0, "file name missing");
+            writeEvent(eventLog, detector->event(), stream.freq(), stream.sampleRate(), N);
         }
-        else
+        std::cout << "Meteor echoes: " << detector->events() << " in " << detector->spectra() << " rows" << std::endl;
+    }
+    if(writer.failed())
+    {
+        throw std::runtime_error{"Writing to " + outputName + " failed"};
+    }
+    std::cout << "Rows written: " << writer.rowsWritten() << ", " << outputName << " holds "
+              << writer.rowsBefore() + writer.rowsWritten() << " rows" << std::endl;
+    std::cout << "\nDone." << std::endl;
+}
+
+void plot(const arguments& arguments)
+{
+    if(hasExtension(arguments.fileName, ".wf"))
+    {
+        plotWaterfall(arguments);
+        return;
+    }
+
+    /*open file with iq counts, it is mapped into memory instead of being read*/
+    IqFile iqs(arguments.fileName);
+    const IqHeader& header = iqs.header();
+    const int currentBlockLenght = header.blockLenght;
+    const long long currentNumberOfBlocks = header.numberOfBlocks;
+
+    std::cout << "current format: version " << header.version << ", " << iqFormatName(header.format)
+              << (iqs.indexed() ? ", indexed" : "") << (iqs.coded() ? ", coded" : "") << std::endl;
+    std::cout << "current frequency: " << header.freq << std::endl;
+    std::cout << "current sample rate: " << header.sampleRate << std::endl;
+    std::cout << "current block lenght: " << currentBlockLenght << std::endl;
+    std::cout << "current numbers of blocks: " << currentNumberOfBlocks << std::endl;
+    std::cout << "current gain: " << header.gain << std::endl;
+    std::cout << "current bandwidth " << header.bandwidth << std::endl;
+
+    if(currentBlockLenght <= 0)
+    {
+        throw std::runtime_error{arguments.fileName + " has invalid block lenght"};
+    }
+
+    /*
+    the header may not match the data (e.g. truncated recording),
+    trust the file size and process every whole block that is on disk  */
+    const long long blocksOnDisk = iqs.blocks();
+    if(blocksOnDisk != currentNumberOfBlocks)
+    {
+        std::cout << "Warning: file holds " << blocksOnDisk << " whole blocks" << std::endl;
+    }
+    long long firstBlock, endBlock;
+    blockRange(arguments, iqs, firstBlock, endBlock);
+    if(endBlock <= firstBlock)
+    {
+        throw std::runtime_error{arguments.fileName + " has no iq counts"};
+    }
+
+    /*
+    Welch estimate: windowed segments are transformed `batchBlocks` at once with one
+    batched plan per worker thread, power of every bin is summed in the same pass.
+    Capture is streamed in chunks of whole blocks, so memory use stays
+    the same for any file size. -d and -c put a channelizer in front   */
+    const int N = currentBlockLenght;
+    WelchSettings welch = welchSettings(arguments, N);
+    SpectrumAverager averager(welch);
+    std::unique_ptr<Channelizer> channelizer = channelizerFor(arguments, header.sampleRate);
+    std::unique_ptr<IqWriter> saved = decimatedCapture(arguments, header, channelizer.get());
+    IqStream stream(iqs, channelizer.get(), saved.get(), firstBlock, endBlock, arguments.threads);
+    const std::complex<int8_t>* samples;
+    size_t count;
+    while(stream.next(samples, count))
+    {
+        averager.process(samples, count);
+    }
+    closeDecimatedCapture(arguments, saved.get());
+    Psd psd = averager.psd(stream.freq(), stream.sampleRate());
+    std::cout << "Welch segments: " << averager.segments() << ", hop " << averager.hop()
+              << " samples, ENBW " << psd.enbwHz << " Hz" << std::endl;
+
+    std::cout << "Now plotting..." <<std::endl;
+    std::cout << "Please, wait..." <<std::endl;
+    
+    //now start plotting
+    PlotSink plotSink;
+    plotSink.submit(psd.freqMHz, psd.dbfsPerHz);
+}
+
+void convert(const arguments& arguments)
+{
+    IqFile iqs(arguments.fileName);
+    const IqHeader& header = iqs.header();
+    if(header.format != IqFormat::cs8)
+    {
+        throw std::runtime_error{std::string{"Only CS8 captures can be converted, "} + arguments.fileName + " holds " +
+                                 iqFormatName(header.format) + " counts"};
+    }
+    long long firstBlock, endBlock;
+    blockRange(arguments, iqs, firstBlock, endBlock);
+    std::cout << "Copying version " << header.version << " capture " << arguments.fileName << " to "
+              << arguments.convertFileName << std::endl;
+
+    /*blocks keep their time stamps and flags, the index is built on the way*/
+    IqHeader converted = header;
+    converted.numberOfBlocks = std::max(0LL, endBlock - firstBlock);
+    converted.codec = arguments.compress ? IqCodec::rice : IqCodec::none;
+    IqWriter writer(arguments.convertFileName, converted);
+    const int N = header.blockLenght;
+    const double blockNs = N / header.sampleRate * 1e9;
+    IqChunkReader reader(iqs, std::max(1LL, (8LL << 20) / (N * 2)), firstBlock, endBlock, arguments.threads);
+    const std::complex<int8_t>* chunk;
+    long long chunkBlocks;
+    while(reader.next(chunk, chunkBlocks))
+    {
+        const long long first = reader.position() - chunkBlocks;
+        for(long long b = 0; b < chunkBlocks; b++)
         {
-            arguments->fileName = std::string{arg};
-            arguments->measure = false;
-            arguments->plot = true;
-            arguments->customFileName = true;
+            long long timeNs;
+            int flags;
+            if(!iqs.blockTime(first + b, timeNs, flags))
+            {
+                timeNs = static_cast<long long>((first + b) * blockNs);
+            }
+            writer.write(chunk + b * N, timeNs, flags);
         }
-        break;
-    case 's':
-        try
+    }
+    writer.close();
+    if(writer.failed())
+    {
+        throw std::runtime_error{"Writing to " + arguments.convertFileName + " failed"};
+    }
+    std::cout << "Blocks copied: " << writer.blocks() << std::endl;
+    std::cout << "\nDone." << std::endl;
+}
+
+/*settings that shape the spectrum of a capture, nothing else changes a batch result*/
+static uint64_t batchSettingsHash(const arguments& arguments)
+{
+    std::ostringstream text;
+    text.precision(17);
+    text << "welch " << arguments.window << " " << arguments.overlap << " " << arguments.removeDc
+         << " channel " << arguments.channelRate << " " << arguments.channelShift
+         << " range " << arguments.rangeStart << " " << arguments.rangeSeconds;
+    return hashString(text.str());
+}
+
+/*one row of the batch summary*/
+struct BatchResult
+{
+    bool cached = false;
+    std::string error;
+    CachedSpectrum spectrum;
+    double seconds = 0;
+};
+
+/*
+the spectrum plot() would show for `fileName`, on the calling thread only.
+Averagers are kept between captures of the same block lenght,
+FFTW plans are only made and destroyed under `plannerLock` */
+static CachedSpectrum averageCapture(const arguments& arguments, const std::string& fileName,
+                                     std::unique_ptr<SpectrumAverager>& averager, std::mutex& plannerLock)
+{
+    IqFile iqs(fileName);
+    const IqHeader& header = iqs.header();
+    const int N = header.blockLenght;
+    long long firstBlock, endBlock;
+    blockRange(arguments, iqs, firstBlock, endBlock);
+    if(endBlock <= firstBlock)
+    {
+        throw std::runtime_error{fileName + " has no iq counts"};
+    }
+    if(!averager || averager->lenght() != N)
+    {
+        WelchSettings welch = welchSettings(arguments, N);
+        welch.threads = 1;
+        std::lock_guard<std::mutex> lock(plannerLock);
+        averager.reset(new SpectrumAverager(welch));
+    }
+    averager->reset();
+
+    std::unique_ptr<Channelizer> channelizer;
+    if(arguments.channelRate > 0 || arguments.channelShift != 0)
+    {
+        channelizer.reset(new Channelizer(header.sampleRate, arguments.channelShift,
+                                          decimationFor(header.sampleRate, arguments.channelRate)));
+    }
+    IqStream stream(iqs, channelizer.get(), nullptr, firstBlock, endBlock);
+    const std::complex<int8_t>* samples;
+    size_t count;
+    while(stream.next(samples, count))
+    {
+        averager->process(samples, count);
+    }
+    CachedSpectrum spectrum;
+    spectrum.freq = stream.freq();
+    spectrum.sampleRate = stream.sampleRate();
+    spectrum.blocks = endBlock - firstBlock;
+    spectrum.segments = averager->segments();
+    spectrum.psd = averager->psd(stream.freq(), stream.sampleRate());
+    return spectrum;
+}
+
+/*median of the bins, the noise floor when the band is mostly empty*/
+static double medianDb(std::vector<double> db)
+{
+    std::nth_element(db.begin(), db.begin() + db.size() / 2, db.end());
+    return db[db.size() / 2];
+}
+
+static void writeBatchRow(std::ostream& out, const std::string& fileName, const BatchResult& result, bool csv)
+{
+    const std::string separator = csv ? "," : " ";
+    out << (csv ? fileName : fileName + std::string(std::max<int>(1, 40 - static_cast<int>(fileName.size())), ' '));
+    if(!result.error.empty())
+    {
+        out << separator << "error: " << result.error << '\n';
+        return;
+    }
+    const CachedSpectrum& s = result.spectrum;
+    const size_t peak = std::max_element(s.psd.dbfsPerHz.begin(), s.psd.dbfsPerHz.end()) - s.psd.dbfsPerHz.begin();
+    const int width = csv ? 0 : 12;
+    out << std::fixed << std::setprecision(6)
+        << separator << std::setw(width) << s.freq / 1e6
+        << separator << std::setprecision(0) << std::setw(width) << s.sampleRate
+        << separator << std::setw(width) << s.blocks
+        << separator << std::setw(width) << s.segments
+        << separator << std::setprecision(2) << std::setw(width) << s.psd.dbfsPerHz[peak]
+        << separator << std::setprecision(6) << std::setw(width) << s.psd.freqMHz[peak]
+        << separator << std::setprecision(2) << std::setw(width) << medianDb(s.psd.dbfsPerHz)
+        << separator << (result.cached ? "cache" : "averaged") << '\n';
+    out.unsetf(std::ios::floatfield);
+}
+
+void batch(const arguments& arguments)
+{
+    const std::vector<std::string> files = listCaptures(arguments.batchPath);
+    if(files.empty())
+    {
+        throw std::runtime_error{"No .iq files in " + arguments.batchPath};
+    }
+    int workers = arguments.threads;
+    if(workers <= 0)
+    {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers = static_cast<int>(std::min<size_t>(workers, files.size()));
+    SpectrumCache cache;
+    const uint64_t settings = batchSettingsHash(arguments);
+    std::cout << "Averaging " << files.size() << " captures on " << workers << " workers, spectra are cached in "
+              << cacheDirectory << std::endl;
+
+    /*
+    every worker takes the next capture until none is left, so long and short
+    captures even out. One capture is averaged on one thread, bit-identical to -p */
+    std::vector<BatchResult> results(files.size());
+    std::atomic<size_t> nextFile{0};
+    std::mutex plannerLock;
+    std::mutex outputLock;
+    size_t finished = 0;
+    const auto startTime = std::chrono::steady_clock::now();
+    auto worker = [&]()
+    {
+        std::unique_ptr<SpectrumAverager> averager;
+        for(size_t i = nextFile++; i < files.size(); i = nextFile++)
         {
-            arguments->sampleRate = std::stod(std::string{*arg});
-            std::cout << "New sample rate: " << static_cast<long>(arguments->sampleRate) << std::endl;
-            arguments->settingsUpdated = true;
+            BatchResult& result = results[i];
+            const auto fileStart = std::chrono::steady_clock::now();
+            try
+            {
+                const uint64_t content = cache.contentHash(files[i]);
+                result.cached = cache.load(content, settings, result.spectrum);
+                if(!result.cached)
+                {
+                    result.spectrum = averageCapture(arguments, files[i], averager, plannerLock);
+                    cache.store(content, settings, result.spectrum);
+                }
+            }
+            catch(const std::exception& e)
+            {
+                result.error = e.what();
+            }
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - fileStart).count();
+
+            std::lock_guard<std::mutex> lock(outputLock);
+            std::cout << "[" << ++finished << "/" << files.size() << "] " << files[i] << ": "
+                      << (!result.error.empty() ? result.error : result.cached ? "cached" : "averaged in " +
+                          std::to_string(result.seconds) + " s") << std::endl;
         }
-        catch(const std::invalid_argument& e)
+        std::lock_guard<std::mutex> lock(plannerLock);
+        averager.reset();
+    };
+    std::vector<std::thread> pool;
+    for(int w = 1; w < workers; w++)
+    {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for(std::thread& t : pool)
+    {
+        t.join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    const std::string columns[] = {"center MHz", "rate S/s", "blocks", "segments", "peak dB/Hz", "peak MHz", "floor dB/Hz"};
+    std::cout << "\n" << std::left << std::setw(40) << "file" << std::right;
+    for(const std::string& column : columns)
+    {
+        std::cout << " " << std::setw(12) << column;
+    }
+    std::cout << " source\n";
+    size_t cached = 0, failed = 0;
+    for(size_t i = 0; i < files.size(); i++)
+    {
+        writeBatchRow(std::cout, files[i], results[i], false);
+        cached += results[i].cached;
+        failed += !results[i].error.empty();
+    }
+    std::cout << files.size() << " captures, " << cached << " from the cache, " << failed << " failed, "
+              << seconds << " s" << std::endl;
+
+    if(arguments.customFileName && !arguments.fileName.empty())
+    {
+        std::ofstream csv(arguments.fileName, std::ios::trunc);
+        csv << "file";
+        for(const std::string& column : columns)
         {
-            std::cout << "-s: invalid argument" << '\n';
+            csv << "," << column;
         }
-        break;
-    case 'f':
-        try
+        csv << ",source\n";
+        for(size_t i = 0; i < files.size(); i++)
         {
-            arguments->freq = std::stod(std::string{*arg});
-            std::cout << "New frequency: " << static_cast<long>(arguments->freq) << std::endl;
-            arguments->settingsUpdated = true;
-            arguments->measure = false;
+            writeBatchRow(csv, files[i], results[i], true);
         }
-        catch(const std::invalid_argument& e)
+        if(!csv)
         {
-            std::cout << "-f: invalid argument" << '\n';
+            throw std::runtime_error{"Writing to " + arguments.fileName + " failed"};
         }
-        break;
-    case 'g':
-        try
+        std::cout << "Summary saved to " << arguments.fileName << std::endl;
+    }
+    std::cout << "\nDone." << std::endl;
+}
+
+int parse_opt(int key, char* arg, struct argp_state* state)
+{
+    struct arguments* arguments = reinterpret_cast<struct arguments*>(state->input);
+    std::string strArg;
+    if(arg != 0)
+    {
+        strArg = arg;
+    }
+    /*a value that cannot be used ends the run with what is wrong with it*/
+    try
+    {
+        switch (key)
         {
-            arguments->gain = std::stoi(std::string{*arg});
-            std::cout << "New gain: " << arguments->gain << std::endl;
-            arguments->settingsUpdated = true;
+        case 'o':
+            if(strArg.empty() || isFilenameValid(strArg))
+            {
+                arguments->fileName = strArg;
+                std::cout << "You can find the results in " << strArg << " file" << std::endl;
+                arguments->customFileName = true;
+            }
+            else
+            {
+                std::cout << "Error in file naming. Default file name will be used" << std::endl;
+            }
+            break;
+        case 'p':
+            if(arg == 0)
+            {
+                argp_failure(state, 1, 0, "file name missing");
+            }
+            else
+            {
+                arguments->fileName = std::string{arg};
+                arguments->measure = false;
+                arguments->plot = true;
+                arguments->customFileName = true;
+            }
+            break;
+        /*kept until the profile is loaded, so that it cannot override what was asked for here*/
+        case 's':
+            arguments->overrides.emplace_back("sample_rate", strArg);
+            break;
+        case 'f':
+            arguments->overrides.emplace_back("freq", strArg);
+            break;
+        case 'g':
+            arguments->overrides.emplace_back("gain", strArg);
+            break;
+        case 'b':
+            arguments->overrides.emplace_back("bandwidth", strArg);
+            break;
+        case 'l':
+            arguments->overrides.emplace_back("block_lenght", strArg);
+            break;
+        case 'n':
+            arguments->overrides.emplace_back("number_of_blocks", strArg);
+            break;
+        case 'S':
+            arguments->showSettings = true;
+            break;
+        case 'B':
+            arguments->batchBlocks = parseInteger(strArg, 1, 1 << 20);
+            break;
+        case 'j':
+            arguments->threads = parseInteger(strArg, 0, 4096);
+            break;
+        case 'R':
+            arguments->overrides.emplace_back("ring_blocks", strArg);
+            break;
+        case 'L':
+            arguments->liveWindow = parseInteger(strArg, 1, 2e9);
+            arguments->live = true;
             arguments->measure = false;
-        }
-        catch(const std::invalid_argument& e)
-        {
-            std::cout << "-g: invalid argument" << '\n';
-        }
-        break;
-    case 'b':
-        try
-        {
-            arguments->bandwidth = std::stoi(std::string{*arg});
-            std::cout << "New bandwidth: " << arguments->bandwidth << std::endl;
-            arguments->settingsUpdated = true;
+            break;
+        case 'D':
+            arguments->overrides.emplace_back("remove_dc", "true");
+            break;
+        case 'W':
+            arguments->overrides.emplace_back("window", strArg);
+            break;
+        case 'O':
+            arguments->overrides.emplace_back("overlap", strArg);
+            break;
+        case 'w':
+            arguments->waterfallBlocks = parseInteger(strArg, 1, 2e9);
+            break;
+        case 'q':
+            waterfallFormatFromName(strArg);
+            arguments->waterfallFormat = strArg;
+            break;
+        case 'E':
+            arguments->carrierOffset = parseRange(strArg, -1e10, 1e10);
+            arguments->detect = true;
+            break;
+        case 'T':
+            arguments->detectThreshold = parseRange(strArg, 0, 200);
+            break;
+        case 'H':
+            arguments->detectSpan = parseRange(strArg, 0, 1e10);
+            break;
+        case 'd':
+            arguments->channelRate = parseRange(strArg, 0, 1e10);
+            break;
+        case 'c':
+            arguments->channelShift = parseRange(strArg, -1e10, 1e10);
+            break;
+        case 'X':
+            if(isFilenameValid(strArg))
+            {
+                arguments->decimatedFileName = strArg;
+            }
+            break;
+        case 'V':
+            if(isFilenameValid(strArg))
+            {
+                arguments->convertFileName = strArg;
+            }
+            break;
+        case 'Z':
+            arguments->overrides.emplace_back("compress", "true");
+            break;
+        case 'A':
+            arguments->batchPath = strArg;
+            arguments->batch = true;
             arguments->measure = false;
-        }
-        catch(const std::invalid_argument& e)
+            break;
+        case 'k':
         {
-            std::cout << "-b: invalid argument" << '\n';
+            const size_t colon = strArg.find(':');
+            arguments->rangeStart = parseRange(strArg.substr(0, colon), 0, 1e9);
+            arguments->rangeSeconds = colon == std::string::npos ? 0 : parseRange(strArg.substr(colon + 1), 0, 1e9);
+            break;
         }
-        break;
-    case 'l':
-        try
-        {
-            arguments->blockLenght = std::stoi(std::string{*arg});
-            std::cout << "New block lenght: " << arguments->blockLenght << std::endl;
-            arguments->settingsUpdated = true;
+        case 'F':
+            /*the steps are counted once the sample rate of the run is known, in main*/
+            checkSweepSpec(strArg);
+            arguments->sweepSpec = strArg;
+            arguments->sweep = true;
             arguments->measure = false;
-        }
-        catch(const std::invalid_argument& e)
-        {
-            std::cerr << "-l: invalid argument" << '\n';
-        }
-        break;
-    case 'n':
-        try
-        {
-            arguments->numberOfBlocks = std::stoi(std::string{*arg});
-            std::cout << "New number of blocks: " << arguments->numberOfBlocks << std::endl;
-            arguments->settingsUpdated = true;
+            break;
+        case 'G':
+            arguments->settleMs = parseRange(strArg, 0, 1e7);
+            break;
+        case 'm':
+            arguments->metricsSeconds = parseRange(strArg, 0, 1e6);
+            break;
+        case 'e':
+            arguments->metricsEndpoint = strArg;
+            break;
+        case 'M':
+            arguments->deviceSerials = strArg;
+            break;
+        case 'I':
+            arguments->source = strArg;
+            break;
+        case 'x':
+            arguments->replaySpeed = parseRange(strArg, 0, 1e6);
+            break;
+        case 'P':
+            arguments->overrides.emplace_back("planner", strArg);
+            break;
+        case 'r':
+            arguments->overrides.emplace_back("segment", strArg);
+            break;
+        case 'Q':
+            arguments->overrides.emplace_back("disk_budget", strArg);
+            break;
+        case 'N':
+            arguments->overrides.emplace_back("drop_cache", "true");
+            break;
+        case 'C':
+            if(!isProfileNameValid(strArg))
+            {
+                argp_failure(state, 1, 0, "-C: a profile name is made of letters, digits, '.', '-' and '_'");
+            }
+            arguments->profile = strArg;
+            break;
+        case 'U':
+            arguments->saveProfile = true;
             arguments->measure = false;
+            break;
         }
-        catch(const std::invalid_argument& e)
-        {
-            std::cerr << "-n: invalid argument" << '\n';
-        }
-        break;
-    case 'S':
-        arguments->showSettings = true;
-        break;
+    }
+    catch(const std::invalid_argument& e)
+    {
+        argp_failure(state, 1, 0, "-%c: %s", key, e.what());
     }
 
     return 0;
@@ -3,12 +3,11 @@
 
 #include <ctime>
 #include <string>
+#include <vector>
+#include <utility>
 #include <iostream>
 #include <argp.h>
 
-/*SDR channel*/
-constexpr int channel = 0;
-
 /*argp stuff*/
 /*list of arguments and fucntion for argp parsing*/
 struct arguments
@@ -16,7 +15,6 @@ struct arguments
     bool showSettings = false;
     bool measure = true;
     bool plot = false;
-    bool settingsUpdated = false;
     bool customFileName = false;
         //default settings
     double sampleRate = 250000.0;       //use -s to change it
@@ -26,14 +24,59 @@ struct arguments
     int blockLenght = 1024;             //use -l to change it
     int numberOfBlocks = 100;           //use -n to change it
     std::string fileName = "";
+    std::string planner = "measure";    //use -P to change it
+    int batchBlocks = 64;               //use -B to change it
+    int threads = 1;                    //use -j to change it, 0 means all cores
+    int ringBlocks = 256;               //use -R to change it
+    bool removeDc = false;              //use -D to change it
+    std::string window = "hann";        //use -W to change it
+    int overlap = 50;                   //use -O to change it, percent
+    bool live = false;
+    int liveWindow = 100;               //use -L to change it
+    int waterfallBlocks = 0;            //use -w to change it, 0 plots one averaged spectrum
+    std::string waterfallFormat = "uint8";  //use -q to change it
+    bool detect = false;
+    double carrierOffset = 0;           //use -E to change it, Hz from the center frequency
+    double detectThreshold = 10;        //use -T to change it, dB over the noise floor
+    double detectSpan = 1000;           //use -H to change it, Hz either side of the carrier
+    double channelRate = 0;             //use -d to change it, 0 keeps the full sample rate
+    double channelShift = 0;            //use -c to change it, Hz from the center frequency
+    std::string decimatedFileName = ""; //use -X to change it
+    std::string convertFileName = "";   //use -V to change it
+    double rangeStart = 0;              //use -k to change it, seconds from the first block
+    double rangeSeconds = 0;            //use -k to change it, 0 reads to the end of the capture
+    bool compress = false;              //use -Z to change it
+    bool batch = false;
+    std::string batchPath = "";         //use -A to change it
+    std::string source = "soapy";       //use -I to change it
+    double replaySpeed = 1;             //use -x to change it, times real time, 0 as fast as possible
+    bool sweep = false;
+    std::string sweepSpec = "";         //use -F to change it
+    double settleMs = 20;               //use -G to change it, dropped after every retune of a sweep
+    std::string deviceSerials = "";     //use -M to change it, comma separated
+    double metricsSeconds = 0;          //use -m to change it, 0 prints no metrics
+    std::string metricsEndpoint = "";   //use -e to change it
+    double segmentSeconds = 0;          //use -r to change it, with segmentBytes 0 measure saves one file of -n blocks
+    long long segmentBytes = 0;         //use -r to change it
+    long long diskBudget = 0;           //use -Q to change it, 0 keeps every segment
+    bool dropCache = false;             //use -N to change it
+    std::string profile = "default";    //use -C to change it
+    bool saveProfile = false;           //use -U to change it
+    /*settings given on the command line, key of radar.conf and value, applied over the profile*/
+    std::vector<std::pair<std::string, std::string>> overrides;
 };
 int parse_opt(int key, char* arg, struct argp_state* state);
 
 const std::string getTimeString();
 bool isFilenameValid(const std::string&);
 bool isIQextensionValid(const std::string&);
-void saveSettingToFile(const struct arguments&);
 void measure(const struct arguments&);
+void measureDevices(const struct arguments&);
 void plot(const struct arguments&);
+void live(const struct arguments&);
+void spectrogram(const struct arguments&);
+void convert(const struct arguments&);
+void batch(const struct arguments&);
+void sweep(const struct arguments&);
 
 #endif
\ No newline at end of file
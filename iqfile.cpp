@@ -0,0 +1,759 @@
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "iqfile.h"
+#include "rxblock.h"
+#include "metrics.h"
+
+size_t iqSampleSize(IqFormat format)
+{
+    switch(format)
+    {
+    case IqFormat::cs8:
+        return 2 * sizeof(int8_t);
+    case IqFormat::cs16:
+        return 2 * sizeof(int16_t);
+    case IqFormat::cf32:
+        return 2 * sizeof(float);
+    }
+    return 0;
+}
+
+const char* iqFormatName(IqFormat format)
+{
+    switch(format)
+    {
+    case IqFormat::cs8:
+        return "CS8";
+    case IqFormat::cs16:
+        return "CS16";
+    case IqFormat::cf32:
+        return "CF32";
+    }
+    return "unknown";
+}
+
+/*the v2 header field by field, the header is not padded*/
+static IqFileHeader readFileHeader(const char* p)
+{
+    IqFileHeader header;
+    std::memcpy(header.magic, p, sizeof(header.magic));
+    std::memcpy(&header.byteOrder, p + 4, sizeof(header.byteOrder));
+    std::memcpy(&header.version, p + 8, sizeof(header.version));
+    std::memcpy(&header.format, p + 12, sizeof(header.format));
+    std::memcpy(&header.freq, p + 16, sizeof(header.freq));
+    std::memcpy(&header.sampleRate, p + 24, sizeof(header.sampleRate));
+    std::memcpy(&header.numberOfBlocks, p + 32, sizeof(header.numberOfBlocks));
+    std::memcpy(&header.indexOffset, p + 40, sizeof(header.indexOffset));
+    std::memcpy(&header.blockLenght, p + 48, sizeof(header.blockLenght));
+    std::memcpy(&header.gain, p + 52, sizeof(header.gain));
+    std::memcpy(&header.bandwidth, p + 56, sizeof(header.bandwidth));
+    std::memcpy(&header.codec, p + 60, sizeof(header.codec));
+    return header;
+}
+
+static void writeFileHeader(std::fstream& file, const IqFileHeader& header)
+{
+    file.write(header.magic, sizeof(header.magic));
+    file.write(reinterpret_cast<const char*>(&header.byteOrder), sizeof(header.byteOrder));
+    file.write(reinterpret_cast<const char*>(&header.version), sizeof(header.version));
+    file.write(reinterpret_cast<const char*>(&header.format), sizeof(header.format));
+    file.write(reinterpret_cast<const char*>(&header.freq), sizeof(header.freq));
+    file.write(reinterpret_cast<const char*>(&header.sampleRate), sizeof(header.sampleRate));
+    file.write(reinterpret_cast<const char*>(&header.numberOfBlocks), sizeof(header.numberOfBlocks));
+    file.write(reinterpret_cast<const char*>(&header.indexOffset), sizeof(header.indexOffset));
+    file.write(reinterpret_cast<const char*>(&header.blockLenght), sizeof(header.blockLenght));
+    file.write(reinterpret_cast<const char*>(&header.gain), sizeof(header.gain));
+    file.write(reinterpret_cast<const char*>(&header.bandwidth), sizeof(header.bandwidth));
+    file.write(reinterpret_cast<const char*>(&header.codec), sizeof(header.codec));
+}
+
+static IqIndexEntry readIndexEntry(const char* p)
+{
+    IqIndexEntry entry;
+    std::memcpy(&entry.timeNs, p, sizeof(entry.timeNs));
+    std::memcpy(&entry.offset, p + 8, sizeof(entry.offset));
+    std::memcpy(&entry.flags, p + 16, sizeof(entry.flags));
+    std::memcpy(&entry.bytes, p + 20, sizeof(entry.bytes));
+    return entry;
+}
+
+static bool isKnownFormat(IqFormat format)
+{
+    return format == IqFormat::cs8 || format == IqFormat::cs16 || format == IqFormat::cf32;
+}
+
+IqFile::IqFile(const std::string& fileName)
+{
+    fd = open(fileName.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        throw std::runtime_error{"Cannot open the " + fileName + " Did you write its name correctly?"};
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < iqLegacyHeaderSize)
+    {
+        close(fd);
+        throw std::runtime_error{fileName + " is too short to be an .iq file"};
+    }
+    mapSize = st.st_size;
+
+    map = mmap(nullptr, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+    if(map == MAP_FAILED)
+    {
+        close(fd);
+        throw std::runtime_error{"Cannot map " + fileName};
+    }
+    /*counts are read front to back, let the kernel read ahead aggressively*/
+    madvise(map, mapSize, MADV_SEQUENTIAL);
+
+    const char* p = static_cast<const char*>(map);
+    std::string error;
+    if(mapSize >= iqFileHeaderSize && std::memcmp(p, "IQCP", 4) == 0)
+    {
+        const IqFileHeader file = readFileHeader(p);
+        hdr.version = file.version;
+        hdr.format = file.format;
+        hdr.codec = file.codec;
+        hdr.freq = file.freq;
+        hdr.sampleRate = file.sampleRate;
+        hdr.numberOfBlocks = file.numberOfBlocks;
+        hdr.blockLenght = file.blockLenght;
+        hdr.gain = file.gain;
+        hdr.bandwidth = file.bandwidth;
+        const long long blockBytes = static_cast<long long>(std::max(0, file.blockLenght)) * iqSampleSize(file.format);
+        if(file.byteOrder == 0x04030201)
+        {
+            error = fileName + " was written on a machine of the other byte order";
+        }
+        else if(file.byteOrder != 0x01020304 || file.version != 2)
+        {
+            error = fileName + " is an .iq file of an unsupported version";
+        }
+        else if(!isKnownFormat(file.format) || blockBytes <= 0 || !(file.sampleRate > 0))
+        {
+            error = fileName + " has an invalid header";
+        }
+        else if(file.codec != IqCodec::none && (file.codec != IqCodec::rice || file.format != IqFormat::cs8))
+        {
+            error = fileName + " is coded in a way this version cannot read";
+        }
+        else if(file.indexOffset != 0)
+        {
+            /*closed capture: every block is where its index entry says*/
+            if(file.indexOffset < static_cast<long long>(iqFileHeaderSize) || file.numberOfBlocks < 0 ||
+               file.numberOfBlocks > static_cast<long long>(mapSize / iqIndexEntrySize) ||
+               file.indexOffset + file.numberOfBlocks * static_cast<long long>(iqIndexEntrySize) > static_cast<long long>(mapSize))
+            {
+                error = fileName + " has a damaged block index";
+            }
+            else
+            {
+                index = p + file.indexOffset;
+                blockCount = file.numberOfBlocks;
+                /*
+                every entry is checked once here, so blocks are read without checks later:
+                blocks follow each other between the header and the index, uncoded ones
+                back to back as the chunk readers take them */
+                long long end = iqFileHeaderSize;
+                for(long long i = 0; i < blockCount && error.empty(); i++)
+                {
+                    const IqIndexEntry entry = readIndexEntry(index + i * iqIndexEntrySize);
+                    const bool placed = file.codec == IqCodec::none
+                        ? entry.offset == static_cast<long long>(iqFileHeaderSize) + i * blockBytes && entry.bytes == blockBytes
+                        : entry.offset >= end && entry.bytes >= 0;
+                    if(!placed || entry.offset + entry.bytes > file.indexOffset)
+                    {
+                        error = fileName + " has a damaged block index (block " + std::to_string(i) + ")";
+                    }
+                    end = entry.offset + entry.bytes;
+                }
+            }
+        }
+        else if(file.codec != IqCodec::none)
+        {
+            /*coded blocks cannot be found from the file size, the index in progress is needed*/
+            std::ifstream indexFile(fileName + ".idx", std::ios::binary | std::ios::ate);
+            if(!indexFile.is_open())
+            {
+                error = fileName + " was not closed and its " + fileName + ".idx is missing";
+            }
+            else
+            {
+                recoveredIndex.resize(static_cast<size_t>(indexFile.tellg()) / iqIndexEntrySize * iqIndexEntrySize);
+                indexFile.seekg(0);
+                indexFile.read(recoveredIndex.data(), recoveredIndex.size());
+                index = recoveredIndex.data();
+                /*blocks that made it to the disk completely*/
+                const long long entries = recoveredIndex.size() / iqIndexEntrySize;
+                long long recoveredEnd = iqFileHeaderSize;
+                while(blockCount < entries)
+                {
+                    const IqIndexEntry entry = readIndexEntry(index + blockCount * iqIndexEntrySize);
+                    if(entry.offset < recoveredEnd || entry.bytes < 0 ||
+                       entry.offset + entry.bytes > static_cast<long long>(mapSize))
+                    {
+                        break;
+                    }
+                    recoveredEnd = entry.offset + entry.bytes;
+                    blockCount++;
+                }
+            }
+        }
+        else
+        {
+            /*the writer did not get to close it, every whole block on disk still counts*/
+            blockCount = (mapSize - iqFileHeaderSize) / blockBytes;
+            timeFile.open(fileName + ".idx", std::ios::binary);
+            timeEntrySize = iqIndexEntrySize;
+        }
+        data = p + iqFileHeaderSize;
+    }
+    else
+    {
+        /*version 1: read settings field by field, the header is not padded*/
+        int numberOfBlocks;
+        std::memcpy(&hdr.freq, p, sizeof(double));
+        p += sizeof(double);
+        std::memcpy(&hdr.sampleRate, p, sizeof(double));
+        p += sizeof(double);
+        std::memcpy(&numberOfBlocks, p, sizeof(int));
+        p += sizeof(int);
+        std::memcpy(&hdr.blockLenght, p, sizeof(int));
+        p += sizeof(int);
+        std::memcpy(&hdr.gain, p, sizeof(int));
+        p += sizeof(int);
+        std::memcpy(&hdr.bandwidth, p, sizeof(int));
+        hdr.version = 1;
+        hdr.format = IqFormat::cs8;
+        hdr.numberOfBlocks = numberOfBlocks;
+
+        /*there is no magic, so refuse anything that cannot be a capture*/
+        if(hdr.blockLenght <= 0 || numberOfBlocks < 0 || !(hdr.sampleRate >= 1 && hdr.sampleRate <= 1e10) ||
+           !(hdr.freq >= 0 && hdr.freq <= 1e12))
+        {
+            error = fileName + " is not an .iq file";
+        }
+        else
+        {
+            data = static_cast<const char*>(map) + iqLegacyHeaderSize;
+            blockCount = (mapSize - iqLegacyHeaderSize) / (hdr.blockLenght * iqSampleSize(IqFormat::cs8));
+            timeFile.open(fileName + ".ts", std::ios::binary);
+            timeEntrySize = sizeof(int64_t) + sizeof(int32_t);
+        }
+    }
+    if(!error.empty())
+    {
+        munmap(map, mapSize);
+        close(fd);
+        throw std::runtime_error{error};
+    }
+}
+
+IqFile::~IqFile()
+{
+    munmap(map, mapSize);
+    close(fd);
+}
+
+long long IqFile::blocks() const
+{
+    return blockCount;
+}
+
+const char* IqFile::blockData(long long i) const
+{
+    if(index)
+    {
+        int64_t offset;
+        std::memcpy(&offset, index + i * iqIndexEntrySize + 8, sizeof(offset));
+        return static_cast<const char*>(map) + offset;
+    }
+    return data + i * blockBytes();
+}
+
+const std::complex<int8_t>* IqFile::block(long long i) const
+{
+    return reinterpret_cast<const std::complex<int8_t>*>(blockData(i));
+}
+
+size_t IqFile::blockBytes() const
+{
+    return static_cast<size_t>(hdr.blockLenght) * iqSampleSize(hdr.format);
+}
+
+size_t IqFile::storedBytes(long long i) const
+{
+    if(index)
+    {
+        int32_t bytes;
+        std::memcpy(&bytes, index + i * iqIndexEntrySize + 20, sizeof(bytes));
+        return bytes;
+    }
+    return blockBytes();
+}
+
+bool IqFile::decode(long long i, std::complex<int8_t>* out) const
+{
+    METRICS_TIME(Stage::decode);
+    if(!coded())
+    {
+        std::memcpy(out, blockData(i), blockBytes());
+        return true;
+    }
+    return decodeBlock(reinterpret_cast<const uint8_t*>(blockData(i)), storedBytes(i), out, hdr.blockLenght);
+}
+
+bool IqFile::blockTime(long long i, long long& timeNs, int& flags) const
+{
+    flags = 0;
+    if(i < 0 || i >= blockCount)
+    {
+        return false;
+    }
+    int64_t time64;
+    int32_t flags32;
+    if(index)
+    {
+        const IqIndexEntry entry = readIndexEntry(index + i * iqIndexEntrySize);
+        time64 = entry.timeNs;
+        flags32 = entry.flags;
+    }
+    else
+    {
+        /*FILE.iq.ts holds int64 time_ns, int32 flags per block, FILE.iq.idx holds index entries*/
+        if(!timeFile.is_open())
+        {
+            return false;
+        }
+        char entry[iqIndexEntrySize];
+        timeFile.clear();
+        timeFile.seekg(i * timeEntrySize);
+        timeFile.read(entry, timeEntrySize);
+        if(!timeFile)
+        {
+            return false;
+        }
+        std::memcpy(&time64, entry, sizeof(time64));
+        std::memcpy(&flags32, entry + (timeEntrySize == iqIndexEntrySize ? 16 : 8), sizeof(flags32));
+    }
+    flags = flags32;
+    if(!(flags32 & blockHasTime))
+    {
+        return false;
+    }
+    timeNs = time64;
+    return true;
+}
+
+/*device time of a block, counted from the first sample when there is none*/
+static long long blockStartNs(const IqFile& file, long long i)
+{
+    long long timeNs;
+    int flags;
+    if(file.blockTime(i, timeNs, flags))
+    {
+        return timeNs;
+    }
+    return static_cast<long long>(i * file.header().blockLenght / file.header().sampleRate * 1e9);
+}
+
+long long IqFile::blockAt(long long timeNs) const
+{
+    /*block times only grow, so a binary search over the index is enough*/
+    long long low = 0;
+    long long high = blockCount;
+    while(low < high)
+    {
+        const long long middle = low + (high - low) / 2;
+        if(blockStartNs(*this, middle) < timeNs)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+void IqFile::release(long long firstBlock, long long blocks) const
+{
+    if(blocks <= 0)
+    {
+        return;
+    }
+    /*only whole pages inside the range can be dropped*/
+    const uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = reinterpret_cast<uintptr_t>(blockData(firstBlock));
+    uintptr_t end = reinterpret_cast<uintptr_t>(blockData(firstBlock + blocks - 1) + storedBytes(firstBlock + blocks - 1));
+    begin = (begin + pageSize - 1) & ~(pageSize - 1);
+    end &= ~(pageSize - 1);
+    if(end > begin)
+    {
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+    }
+}
+
+IqChunkReader::IqChunkReader(const IqFile& file, long long blocksPerChunk, long long firstBlock, long long endBlock,
+                             int threads)
+    : file(file), blocksPerChunk(blocksPerChunk > 0 ? blocksPerChunk : 1),
+      endBlock(endBlock < 0 ? file.blocks() : std::min(endBlock, file.blocks())),
+      threads(threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency())), first(firstBlock)
+{
+}
+
+IqChunkReader::~IqChunkReader()
+{
+    file.release(first, count);
+}
+
+bool IqChunkReader::next(const std::complex<int8_t>*& chunk, long long& blocks)
+{
+    file.release(first, count);
+    first += count;
+    count = std::min(blocksPerChunk, endBlock - first);
+    if(count <= 0)
+    {
+        count = 0;
+        return false;
+    }
+    blocks = count;
+    if(!file.coded())
+    {
+        chunk = file.block(first);
+        return true;
+    }
+
+    /*blocks are coded on their own, every thread decodes a run of them*/
+    const int N = file.header().blockLenght;
+    decoded.resize(static_cast<size_t>(count) * N);
+    const int workers = static_cast<int>(std::min<long long>(threads, count));
+    std::atomic<long long> damaged{-1};
+    auto decodeRun = [&](int worker)
+    {
+        for(long long b = count * worker / workers; b < count * (worker + 1) / workers; b++)
+        {
+            if(!file.decode(first + b, decoded.data() + b * N))
+            {
+                damaged = first + b;
+            }
+        }
+    };
+    std::vector<std::thread> pool;
+    for(int w = 1; w < workers; w++)
+    {
+        pool.emplace_back(decodeRun, w);
+    }
+    decodeRun(0);
+    for(std::thread& t : pool)
+    {
+        t.join();
+    }
+    if(damaged >= 0)
+    {
+        throw std::runtime_error{"Block " + std::to_string(damaged.load()) + " of the capture is damaged"};
+    }
+    chunk = decoded.data();
+    return true;
+}
+
+/*header fields that are patched on close*/
+constexpr std::streamoff numberOfBlocksAt = 32;
+constexpr std::streamoff indexOffsetAt = 40;
+
+long long iqFileBytes(const IqHeader& header, long long blocks)
+{
+    return iqFileHeaderSize + blocks * (header.blockLenght * static_cast<long long>(sizeof(std::complex<int8_t>)) +
+                                        static_cast<long long>(iqIndexEntrySize));
+}
+
+/*a dropCache writer sends this much to the disk at a time, the cache holds about twice that of the file*/
+constexpr long long cacheWindowBytes = 8 << 20;
+
+IqWriter::IqWriter(const std::string& fileName, const IqHeader& header, const IqWriteOptions& options)
+    : fileName(fileName), header(header), options(options)
+{
+    this->header.version = 2;
+    this->header.format = IqFormat::cs8;
+    if(header.codec == IqCodec::rice)
+    {
+        coded.reserve(1 + 2 * static_cast<size_t>(header.blockLenght));
+    }
+    outputFile.open(fileName, std::ios::trunc | std::ios::binary | std::ios::out);
+    if(!outputFile.is_open())
+    {
+        throw std::runtime_error{"Cannot create " + fileName};
+    }
+    indexFile.open(fileName + ".idx", std::ios::trunc | std::ios::binary | std::ios::in | std::ios::out);
+    if(!indexFile.is_open())
+    {
+        throw std::runtime_error{"Cannot create " + fileName + ".idx"};
+    }
+
+    /*write frequency, sample rate amount of blocks and its size*/
+    IqFileHeader file;
+    file.format = this->header.format;
+    file.codec = this->header.codec;
+    file.freq = header.freq;
+    file.sampleRate = header.sampleRate;
+    file.numberOfBlocks = header.numberOfBlocks;
+    file.blockLenght = header.blockLenght;
+    file.gain = header.gain;
+    file.bandwidth = header.bandwidth;
+    writeFileHeader(outputFile, file);
+
+    if(options.preallocateBytes > 0 || options.dropCache)
+    {
+        fd = ::open(fileName.c_str(), O_WRONLY | O_CLOEXEC);
+    }
+    /*
+    the whole file in as few extents as the filesystem can give, and no block
+    allocation while writing. KEEP_SIZE leaves the size to what was written, so
+    an unfinished capture is still read as one. Without support the file just grows */
+    if(fd >= 0 && options.preallocateBytes > 0)
+    {
+        fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, options.preallocateBytes);
+    }
+}
+
+IqWriter::~IqWriter()
+{
+    close();
+}
+
+bool IqWriter::write(const std::complex<int8_t>* samples, long long timeNs, int flags)
+{
+    METRICS_TIME(Stage::write);
+    if(writeFailed)
+    {
+        return false;
+    }
+    /*counts are stored as raw interleaved bytes or coded, one write per block*/
+    size_t blockBytes = header.blockLenght * sizeof(std::complex<int8_t>);
+    if(header.codec == IqCodec::none)
+    {
+        outputFile.write(reinterpret_cast<const char*>(samples), blockBytes);
+    }
+    else
+    {
+        coded.clear();
+        {
+            METRICS_TIME(Stage::encode);
+            encodeBlock(samples, header.blockLenght, coded);
+        }
+        blockBytes = coded.size();
+        outputFile.write(reinterpret_cast<const char*>(coded.data()), blockBytes);
+    }
+    IqIndexEntry entry;
+    entry.timeNs = timeNs;
+    entry.offset = iqFileHeaderSize + bytesWritten;
+    entry.flags = flags;
+    entry.bytes = static_cast<int32_t>(blockBytes);
+    indexFile.write(reinterpret_cast<const char*>(&entry.timeNs), sizeof(entry.timeNs));
+    indexFile.write(reinterpret_cast<const char*>(&entry.offset), sizeof(entry.offset));
+    indexFile.write(reinterpret_cast<const char*>(&entry.flags), sizeof(entry.flags));
+    indexFile.write(reinterpret_cast<const char*>(&entry.bytes), sizeof(entry.bytes));
+    if(!outputFile || !indexFile)
+    {
+        writeFailed = true;
+        return false;
+    }
+    blocksWritten++;
+    bytesWritten += blockBytes;
+    if(options.dropCache && fd >= 0 && iqFileHeaderSize + bytesWritten - syncedBytes >= cacheWindowBytes)
+    {
+        dropWritten();
+    }
+    return true;
+}
+
+void IqWriter::dropWritten()
+{
+    /*
+    start writing back the window that just filled up, then wait for the one
+    before it, which had a whole window's time to get there, and drop it. Only
+    clean pages are dropped, so the wait is what makes the drop work */
+    outputFile.flush();
+    const long long written = iqFileHeaderSize + bytesWritten;
+    sync_file_range(fd, syncedBytes, written - syncedBytes, SYNC_FILE_RANGE_WRITE);
+    if(syncedBytes > droppedBytes)
+    {
+        sync_file_range(fd, droppedBytes, syncedBytes - droppedBytes,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd, droppedBytes, syncedBytes - droppedBytes, POSIX_FADV_DONTNEED);
+        droppedBytes = syncedBytes;
+    }
+    syncedBytes = written;
+}
+
+void IqWriter::close()
+{
+    if(!outputFile.is_open())
+    {
+        return;
+    }
+    /*
+    move the index behind the last block and only then point the header at it,
+    a capture cut short on the way is still read as one that was not closed  */
+    const int64_t indexOffset = iqFileHeaderSize + bytesWritten;
+    const int64_t numberOfBlocks = blocksWritten;
+    outputFile.seekp(indexOffset);
+    indexFile.flush();
+    indexFile.seekg(0);
+    std::vector<char> buffer(1 << 20);
+    for(long long left = numberOfBlocks * static_cast<long long>(iqIndexEntrySize); left > 0 && outputFile;)
+    {
+        const size_t take = static_cast<size_t>(std::min<long long>(left, buffer.size()));
+        if(!indexFile.read(buffer.data(), take))
+        {
+            break;
+        }
+        outputFile.write(buffer.data(), take);
+        left -= take;
+    }
+    const bool indexCopied = indexFile && outputFile;
+    if(indexCopied)
+    {
+        outputFile.flush();
+        outputFile.seekp(numberOfBlocksAt);
+        outputFile.write(reinterpret_cast<const char*>(&numberOfBlocks), sizeof(numberOfBlocks));
+        outputFile.seekp(indexOffsetAt);
+        outputFile.write(reinterpret_cast<const char*>(&indexOffset), sizeof(indexOffset));
+    }
+    outputFile.close();
+    indexFile.close();
+    if(indexCopied && outputFile)
+    {
+        std::remove((fileName + ".idx").c_str());
+    }
+    else
+    {
+        writeFailed = true;
+    }
+    if(fd >= 0)
+    {
+        /*truncating to its own size gives back what was reserved past the end*/
+        struct stat status;
+        if(options.preallocateBytes > 0 && fstat(fd, &status) == 0)
+        {
+            if(ftruncate(fd, status.st_size) != 0)
+            {
+                writeFailed = true;
+            }
+        }
+        if(options.dropCache)
+        {
+            /*once the rest is on the disk none of the file needs to stay in memory*/
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+IqHeader decimatedHeader(const IqHeader& header, const Channelizer& channelizer)
+{
+    IqHeader decimated = header;
+    decimated.freq = header.freq + channelizer.shift();
+    decimated.sampleRate = channelizer.outputRate();
+    decimated.numberOfBlocks = header.numberOfBlocks / channelizer.decimation();
+    decimated.gain = header.gain + channelizer.gainDb();
+    return decimated;
+}
+
+/*amount of iq counts kept in memory at once while streaming*/
+constexpr long long streamChunkBytes = 8 << 20;
+
+static long long blocksPerChunk(const IqHeader& header)
+{
+    const long long blockBytes = std::max(1, header.blockLenght) * static_cast<long long>(sizeof(std::complex<int8_t>));
+    return std::max<long long>(1, streamChunkBytes / blockBytes);
+}
+
+IqStream::IqStream(const IqFile& file, Channelizer* channelizer, IqWriter* saved, long long firstBlock, long long endBlock,
+                   int threads)
+    : file(file), outputHeader(file.header()), channelizer(channelizer), saved(saved),
+      firstBlock(firstBlock), reader(file, blocksPerChunk(file.header()), firstBlock, endBlock, threads)
+{
+    if(file.header().format != IqFormat::cs8)
+    {
+        throw std::runtime_error{std::string{"Only CS8 captures can be processed, this one holds "} +
+                                 iqFormatName(file.header().format) + " counts"};
+    }
+    if(channelizer)
+    {
+        outputHeader = decimatedHeader(file.header(), *channelizer);
+        const int N = file.header().blockLenght;
+        blocks.reset(new DecimatedBlocks(*channelizer, N,
+            [this, N](const std::complex<int8_t>* samples, long long timeNs, int flags)
+            {
+                if(this->saved)
+                {
+                    this->saved->write(samples, timeNs, flags);
+                }
+                decimated.insert(decimated.end(), samples, samples + N);
+            }));
+    }
+}
+
+long long IqStream::timeNs(long long index)
+{
+    const IqHeader& header = file.header();
+    const long long input = firstBlock * header.blockLenght + (channelizer ? index * channelizer->decimation() : index);
+    const long long block = input / header.blockLenght;
+    const double offsetNs = (input - block * header.blockLenght) / header.sampleRate * 1e9;
+    long long blockNs;
+    int flags;
+    if(file.blockTime(block, blockNs, flags))
+    {
+        return blockNs + static_cast<long long>(offsetNs);
+    }
+    return static_cast<long long>(input / header.sampleRate * 1e9);
+}
+
+bool IqStream::next(const std::complex<int8_t>*& samples, size_t& count)
+{
+    const int N = file.header().blockLenght;
+    const std::complex<int8_t>* chunk;
+    long long chunkBlocks;
+    while(reader.next(chunk, chunkBlocks))
+    {
+        if(!channelizer)
+        {
+            samples = chunk;
+            count = static_cast<size_t>(chunkBlocks) * N;
+            return true;
+        }
+        /*block by block, so every decimated block gets its own time stamp*/
+        decimated.clear();
+        const long long first = reader.position() - chunkBlocks;
+        for(long long b = 0; b < chunkBlocks; b++)
+        {
+            long long blockNs;
+            int flags;
+            if(!file.blockTime(first + b, blockNs, flags))
+            {
+                blockNs = static_cast<long long>((first + b) * N / file.header().sampleRate * 1e9);
+            }
+            blocks->push(chunk + b * N, N, blockNs, flags);
+        }
+        if(!decimated.empty())
+        {
+            samples = decimated.data();
+            count = decimated.size();
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,258 @@
+#ifndef _IQFILE_H
+#define _IQFILE_H
+
+#include <string>
+#include <fstream>
+#include <complex>
+#include <cstdint>
+#include <memory>
+#include <cstddef>
+#include <vector>
+#include "channelizer.h"
+#include "codec.h"
+
+/*how the counts of a capture are stored, every one is an interleaved i, q pair*/
+enum class IqFormat : int32_t
+{
+    cs8 = 1,        //int8 i, int8 q, what the RTL-SDR delivers
+    cs16 = 2,       //int16 i, int16 q
+    cf32 = 3        //float i, float q
+};
+/*bytes of one i, q pair*/
+size_t iqSampleSize(IqFormat format);
+const char* iqFormatName(IqFormat format);
+
+/*
+settings of a capture. Version 1 files (written before the v2 container) start with
+six native-endian fields, 32 bytes in total: freq, sampleRate, int numberOfBlocks,
+blockLenght, gain, bandwidth, always CS8 counts, times in the FILE.iq.ts sidecar */
+struct IqHeader
+{
+    int version = 2;
+    IqFormat format = IqFormat::cs8;
+    IqCodec codec = IqCodec::none;
+    double freq = 0;
+    double sampleRate = 0;
+    long long numberOfBlocks = 0;
+    int blockLenght = 0;
+    int gain = 0;
+    int bandwidth = 0;
+};
+constexpr size_t iqLegacyHeaderSize = 2 * sizeof(double) + 4 * sizeof(int);
+
+/*
+version 2 container: this header, the blocks, then the block index.
+`byteOrder` reads 0x01020304 on a machine of the writer's byte order.
+`indexOffset` stays 0 until the writer is closed, the index entries of a
+capture in progress go to FILE.iq.idx and are moved behind the blocks on close.
+Native-endian, 64 bytes, no padding  */
+struct IqFileHeader
+{
+    char magic[4] = {'I', 'Q', 'C', 'P'};
+    uint32_t byteOrder = 0x01020304;
+    int32_t version = 2;
+    IqFormat format = IqFormat::cs8;
+    double freq = 0;
+    double sampleRate = 0;
+    int64_t numberOfBlocks = 0;
+    int64_t indexOffset = 0;
+    int32_t blockLenght = 0;
+    int32_t gain = 0;
+    int32_t bandwidth = 0;
+    IqCodec codec = IqCodec::none;
+};
+constexpr size_t iqFileHeaderSize = 64;
+
+/*one entry of the block index, 24 bytes*/
+struct IqIndexEntry
+{
+    int64_t timeNs = 0;         //valid when flags has blockHasTime
+    int64_t offset = 0;         //first byte of the block from the start of the file
+    int32_t flags = 0;          //BlockFlags
+    int32_t bytes = 0;          //bytes of the block on disk, less than the counts when coded
+};
+constexpr size_t iqIndexEntrySize = 24;
+
+/*
+read-only view of an .iq file of either version. The file is mmap'd, so opening
+costs the same for any size and counts are read straight from the page cache.
+Any block and its time stamp are found in O(1) through the block index.
+Coded blocks are only reached through decode() */
+class IqFile
+{
+public:
+    explicit IqFile(const std::string& fileName);
+    ~IqFile();
+    IqFile(const IqFile&) = delete;
+    IqFile& operator=(const IqFile&) = delete;
+
+    const IqHeader& header() const { return hdr; }
+    /*false when blocks are found from the file size: a version 1 file or an uncoded v2 capture that was not closed*/
+    bool indexed() const { return index != nullptr; }
+    bool coded() const { return hdr.codec != IqCodec::none; }
+
+    /*whole blocks present in the file, may differ from header().numberOfBlocks*/
+    long long blocks() const;
+    /*interleaved i, q counts of block `i`, uncoded CS8 captures only*/
+    const std::complex<int8_t>* block(long long i) const;
+    /*counts of block `i` of a CS8 capture into `out`, false when it is damaged. Safe on any thread*/
+    bool decode(long long i, std::complex<int8_t>* out) const;
+    /*time stamp and flags of block `i`, false when the capture has no time for it (flags are still set)*/
+    bool blockTime(long long i, long long& timeNs, int& flags) const;
+    /*first block that starts at or after `timeNs`, blocks() when there is none*/
+    long long blockAt(long long timeNs) const;
+
+    /*drop already processed blocks from memory, they are read again from disk if needed*/
+    void release(long long firstBlock, long long blocks) const;
+
+private:
+    const char* blockData(long long i) const;
+    size_t blockBytes() const;
+    /*bytes block `i` takes on disk*/
+    size_t storedBytes(long long i) const;
+
+    int fd = -1;
+    void* map = nullptr;
+    size_t mapSize = 0;
+    IqHeader hdr;
+    const char* data = nullptr;
+    long long blockCount = 0;
+    const char* index = nullptr;
+    /*FILE.iq.idx read into memory for a coded capture that was not closed*/
+    std::vector<char> recoveredIndex;
+    /*FILE.iq.ts of a version 1 file, FILE.iq.idx of an unfinished v2 capture*/
+    mutable std::ifstream timeFile;
+    size_t timeEntrySize = 0;
+};
+
+/*
+where the writer thread of a capture puts its blocks: one IqWriter, or a
+SegmentRecorder that moves on to a new file as it goes */
+class BlockSink
+{
+public:
+    virtual ~BlockSink() = default;
+
+    /*false once a write failed, later blocks are ignored*/
+    virtual bool write(const std::complex<int8_t>* samples, long long timeNs, int flags) = 0;
+    virtual void close() = 0;
+
+    virtual long long blocks() const = 0;
+    /*bytes of blocks on disk*/
+    virtual long long bytes() const = 0;
+    virtual bool failed() const = 0;
+};
+
+/*how an IqWriter treats the disk*/
+struct IqWriteOptions
+{
+    /*reserved for the file when it is created (fallocate), what it does not use is given back on close*/
+    long long preallocateBytes = 0;
+    /*
+    written blocks are sent to the disk every few MB and dropped from the page
+    cache once they got there, a long recording does not push out everything else */
+    bool dropCache = false;
+};
+
+/*bytes of a closed v2 file of `blocks` uncoded blocks: header, counts and index*/
+long long iqFileBytes(const IqHeader& header, long long blocks);
+
+/*
+writes a v2 .iq file: header, then the counts one block at a time, then the
+block index with the time stamp and flags of every block. numberOfBlocks in the
+header is set to the blocks actually written on close(). With header.codec set
+every block is coded on the calling thread before it is written */
+class IqWriter : public BlockSink
+{
+public:
+    IqWriter(const std::string& fileName, const IqHeader& header, const IqWriteOptions& options = IqWriteOptions());
+    ~IqWriter();
+    IqWriter(const IqWriter&) = delete;
+    IqWriter& operator=(const IqWriter&) = delete;
+
+    bool write(const std::complex<int8_t>* samples, long long timeNs, int flags) override;
+    void close() override;
+
+    long long blocks() const override { return blocksWritten; }
+    long long bytes() const override { return bytesWritten; }
+    bool failed() const override { return writeFailed; }
+
+private:
+    void dropWritten();
+
+    std::string fileName;
+    std::fstream outputFile;
+    std::fstream indexFile;
+    IqHeader header;
+    IqWriteOptions options;
+    std::vector<uint8_t> coded;
+    long long blocksWritten = 0;
+    long long bytesWritten = 0;
+    bool writeFailed = false;
+    /*second descriptor of the file for fallocate, sync_file_range and fadvise*/
+    int fd = -1;
+    /*bytes of the file sent to the disk and dropped from the cache so far*/
+    long long syncedBytes = 0;
+    long long droppedBytes = 0;
+};
+
+/*
+hands out blocks [firstBlock, endBlock) of the capture in chunks of whole blocks and
+releases every chunk once the next one is requested, so memory use does not depend
+on file size. endBlock < 0 reads to the end of the file. Blocks of a coded capture
+are decoded into a buffer of one chunk, split between `threads` threads */
+class IqChunkReader
+{
+public:
+    IqChunkReader(const IqFile& file, long long blocksPerChunk, long long firstBlock = 0, long long endBlock = -1,
+                  int threads = 1);
+    ~IqChunkReader();
+
+    /*false when there is no whole block left*/
+    bool next(const std::complex<int8_t>*& chunk, long long& blocks);
+    long long position() const { return first + count; }
+
+private:
+    const IqFile& file;
+    long long blocksPerChunk;
+    long long endBlock;
+    int threads;
+    long long first = 0;
+    long long count = 0;
+    std::vector<std::complex<int8_t>> decoded;
+};
+
+/*header of the capture a channelizer makes out of one with `header`*/
+IqHeader decimatedHeader(const IqHeader& header, const Channelizer& channelizer);
+
+/*
+whole blocks [firstBlock, endBlock) of a CS8 .iq file as one stream of counts,
+a chunk at a time. With a channelizer the blocks are shifted and decimated on the
+way and can be saved to another .iq file, their time stamps follow them from the
+block index (counted from the first sample when there is none) */
+class IqStream
+{
+public:
+    IqStream(const IqFile& file, Channelizer* channelizer = nullptr, IqWriter* saved = nullptr,
+             long long firstBlock = 0, long long endBlock = -1, int threads = 1);
+
+    /*false at the end of the file*/
+    bool next(const std::complex<int8_t>*& samples, size_t& count);
+    /*time of sample `index` of the stream, ns*/
+    long long timeNs(long long index);
+
+    double freq() const { return outputHeader.freq; }
+    double sampleRate() const { return outputHeader.sampleRate; }
+
+private:
+    const IqFile& file;
+    IqHeader outputHeader;
+    Channelizer* channelizer;
+    IqWriter* saved;
+    long long firstBlock;
+    IqChunkReader reader;
+    std::unique_ptr<DecimatedBlocks> blocks;
+    std::vector<std::complex<int8_t>> decimated;
+};
+
+#endif
@@ -0,0 +1,257 @@
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+/*scalar versions, also used for the tails the vector loops leave*/
+
+static void convertCs8Scalar(const std::complex<int8_t>* in, float* out, size_t count, float dcI, float dcQ)
+{
+    const int8_t* p = reinterpret_cast<const int8_t*>(in);
+    for(size_t i = 0; i < count; i++)
+    {
+        out[2 * i] = static_cast<float>(p[2 * i]) - dcI;
+        out[2 * i + 1] = static_cast<float>(p[2 * i + 1]) - dcQ;
+    }
+}
+
+static void powerSpectrumScalar(const float* in, float* out, size_t count)
+{
+    for(size_t k = 0; k < count; k++)
+    {
+        out[k] = in[2 * k] * in[2 * k] + in[2 * k + 1] * in[2 * k + 1];
+    }
+}
+
+static void accumulatePowerScalar(const float* in, float* sum, size_t count)
+{
+    for(size_t k = 0; k < count; k++)
+    {
+        sum[k] += in[2 * k] * in[2 * k] + in[2 * k + 1] * in[2 * k + 1];
+    }
+}
+
+static void applyWindowScalar(float* data, const float* window, size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        data[i] *= window[i];
+    }
+}
+
+#ifdef KERNELS_X86
+
+/*SSE2 is always there on x86-64, the attribute only matters for 32-bit builds*/
+
+__attribute__((target("sse2")))
+static void convertCs8Sse2(const std::complex<int8_t>* in, float* out, size_t count, float dcI, float dcQ)
+{
+    const int8_t* p = reinterpret_cast<const int8_t*>(in);
+    const __m128 dc = _mm_setr_ps(dcI, dcQ, dcI, dcQ);
+    const size_t values = count * 2;
+    size_t i = 0;
+    for(; i + 16 <= values; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        /*sign-extend int8 -> int16 -> int32 by unpacking into the high half and shifting*/
+        __m128i lo16 = _mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8);
+        __m128i hi16 = _mm_srai_epi16(_mm_unpackhi_epi8(bytes, bytes), 8);
+        __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(lo16, lo16), 16);
+        __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(lo16, lo16), 16);
+        __m128i c = _mm_srai_epi32(_mm_unpacklo_epi16(hi16, hi16), 16);
+        __m128i d = _mm_srai_epi32(_mm_unpackhi_epi16(hi16, hi16), 16);
+        _mm_storeu_ps(out + i, _mm_sub_ps(_mm_cvtepi32_ps(a), dc));
+        _mm_storeu_ps(out + i + 4, _mm_sub_ps(_mm_cvtepi32_ps(b), dc));
+        _mm_storeu_ps(out + i + 8, _mm_sub_ps(_mm_cvtepi32_ps(c), dc));
+        _mm_storeu_ps(out + i + 12, _mm_sub_ps(_mm_cvtepi32_ps(d), dc));
+    }
+    convertCs8Scalar(in + i / 2, out + i, count - i / 2, dcI, dcQ);
+}
+
+__attribute__((target("sse2")))
+static inline __m128 power4Sse2(const float* in)
+{
+    /*two loads hold re0 im0 re1 im1 | re2 im2 re3 im3, square and add pairs*/
+    __m128 x = _mm_loadu_ps(in);
+    __m128 y = _mm_loadu_ps(in + 4);
+    x = _mm_mul_ps(x, x);
+    y = _mm_mul_ps(y, y);
+    __m128 re = _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 im = _mm_shuffle_ps(x, y, _MM_SHUFFLE(3, 1, 3, 1));
+    return _mm_add_ps(re, im);
+}
+
+__attribute__((target("sse2")))
+static void powerSpectrumSse2(const float* in, float* out, size_t count)
+{
+    size_t k = 0;
+    for(; k + 4 <= count; k += 4)
+    {
+        _mm_storeu_ps(out + k, power4Sse2(in + 2 * k));
+    }
+    powerSpectrumScalar(in + 2 * k, out + k, count - k);
+}
+
+__attribute__((target("sse2")))
+static void accumulatePowerSse2(const float* in, float* sum, size_t count)
+{
+    size_t k = 0;
+    for(; k + 4 <= count; k += 4)
+    {
+        _mm_storeu_ps(sum + k, _mm_add_ps(_mm_loadu_ps(sum + k), power4Sse2(in + 2 * k)));
+    }
+    accumulatePowerScalar(in + 2 * k, sum + k, count - k);
+}
+
+__attribute__((target("sse2")))
+static void applyWindowSse2(float* data, const float* window, size_t count)
+{
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), _mm_loadu_ps(window + i)));
+    }
+    applyWindowScalar(data + i, window + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void convertCs8Avx2(const std::complex<int8_t>* in, float* out, size_t count, float dcI, float dcQ)
+{
+    const int8_t* p = reinterpret_cast<const int8_t*>(in);
+    const __m256 dc = _mm256_setr_ps(dcI, dcQ, dcI, dcQ, dcI, dcQ, dcI, dcQ);
+    const size_t values = count * 2;
+    size_t i = 0;
+    for(; i + 32 <= values; i += 32)
+    {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 16));
+        __m256 a = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(lo));
+        __m256 b = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(lo, 8)));
+        __m256 c = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(hi));
+        __m256 d = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_srli_si128(hi, 8)));
+        _mm256_storeu_ps(out + i, _mm256_sub_ps(a, dc));
+        _mm256_storeu_ps(out + i + 8, _mm256_sub_ps(b, dc));
+        _mm256_storeu_ps(out + i + 16, _mm256_sub_ps(c, dc));
+        _mm256_storeu_ps(out + i + 24, _mm256_sub_ps(d, dc));
+    }
+    convertCs8Scalar(in + i / 2, out + i, count - i / 2, dcI, dcQ);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 power8Avx2(const float* in)
+{
+    /*squares of re0 im0 .. re7 im7, hadd pairs them up per 128-bit lane, permute restores order*/
+    __m256 x = _mm256_loadu_ps(in);
+    __m256 y = _mm256_loadu_ps(in + 8);
+    __m256 s = _mm256_hadd_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y));
+    return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(s), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+__attribute__((target("avx2")))
+static void powerSpectrumAvx2(const float* in, float* out, size_t count)
+{
+    size_t k = 0;
+    for(; k + 8 <= count; k += 8)
+    {
+        _mm256_storeu_ps(out + k, power8Avx2(in + 2 * k));
+    }
+    powerSpectrumScalar(in + 2 * k, out + k, count - k);
+}
+
+__attribute__((target("avx2")))
+static void accumulatePowerAvx2(const float* in, float* sum, size_t count)
+{
+    size_t k = 0;
+    for(; k + 8 <= count; k += 8)
+    {
+        _mm256_storeu_ps(sum + k, _mm256_add_ps(_mm256_loadu_ps(sum + k), power8Avx2(in + 2 * k)));
+    }
+    accumulatePowerScalar(in + 2 * k, sum + k, count - k);
+}
+
+__attribute__((target("avx2")))
+static void applyWindowAvx2(float* data, const float* window, size_t count)
+{
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8)
+    {
+        _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), _mm256_loadu_ps(window + i)));
+    }
+    applyWindowScalar(data + i, window + i, count - i);
+}
+
+#endif
+
+/*kernel set chosen once, on first use*/
+struct Kernels
+{
+    const char* name;
+    void (*convert)(const std::complex<int8_t>*, float*, size_t, float, float);
+    void (*power)(const float*, float*, size_t);
+    void (*accumulate)(const float*, float*, size_t);
+    void (*window)(float*, const float*, size_t);
+};
+
+static Kernels selectKernels()
+{
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        return {"avx2", convertCs8Avx2, powerSpectrumAvx2, accumulatePowerAvx2, applyWindowAvx2};
+    }
+    if(__builtin_cpu_supports("sse2"))
+    {
+        return {"sse2", convertCs8Sse2, powerSpectrumSse2, accumulatePowerSse2, applyWindowSse2};
+    }
+#endif
+    return {"scalar", convertCs8Scalar, powerSpectrumScalar, accumulatePowerScalar, applyWindowScalar};
+}
+
+static const Kernels& kernels()
+{
+    static const Kernels selected = selectKernels();
+    return selected;
+}
+
+void convertCs8(const std::complex<int8_t>* in, float* out, size_t count, float dcI, float dcQ)
+{
+    kernels().convert(in, out, count, dcI, dcQ);
+}
+
+void powerSpectrum(const float* in, float* out, size_t count)
+{
+    kernels().power(in, out, count);
+}
+
+void accumulatePower(const float* in, float* sum, size_t count)
+{
+    kernels().accumulate(in, sum, count);
+}
+
+void applyWindow(float* data, const float* window, size_t count)
+{
+    kernels().window(data, window, count);
+}
+
+void dcOffset(const std::complex<int8_t>* in, size_t count, float& dcI, float& dcQ)
+{
+    /*integer sums are exact and vectorised by the compiler*/
+    const int8_t* p = reinterpret_cast<const int8_t*>(in);
+    long long sumI = 0;
+    long long sumQ = 0;
+    for(size_t i = 0; i < count; i++)
+    {
+        sumI += p[2 * i];
+        sumQ += p[2 * i + 1];
+    }
+    dcI = count > 0 ? static_cast<float>(static_cast<double>(sumI) / count) : 0.0f;
+    dcQ = count > 0 ? static_cast<float>(static_cast<double>(sumQ) / count) : 0.0f;
+}
+
+const char* kernelsName()
+{
+    return kernels().name;
+}
@@ -0,0 +1,29 @@
+#ifndef _KERNELS_H
+#define _KERNELS_H
+
+#include <complex>
+#include <cstdint>
+#include <cstddef>
+
+/*
+hot loops of the spectrum pipeline. Every kernel has a scalar version and,
+on x86, SSE2 and AVX2 versions picked once at run time from the CPU flags.
+Complex floats are interleaved re, im pairs, the layout of fftwf_complex */
+
+/*out = in - dc, int8 counts to complex float*/
+void convertCs8(const std::complex<int8_t>* in, float* out, size_t count, float dcI, float dcQ);
+/*out[k] = |in[k]|^2*/
+void powerSpectrum(const float* in, float* out, size_t count);
+/*sum[k] += |in[k]|^2, power and accumulation in one pass*/
+void accumulatePower(const float* in, float* sum, size_t count);
+
+/*data[k] *= window[k] for count interleaved floats, window is stored interleaved too*/
+void applyWindow(float* data, const float* window, size_t count);
+
+/*mean of i and q counts, the DC offset of the receiver*/
+void dcOffset(const std::complex<int8_t>* in, size_t count, float& dcI, float& dcQ);
+
+/*name of the instruction set the kernels run with: avx2, sse2 or scalar*/
+const char* kernelsName();
+
+#endif
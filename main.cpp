@@ -4,8 +4,11 @@
 3. fftw3
 */
 
-#include <fstream>
+#include <memory>
 #include "functions.h"
+#include "settings.h"
+#include "sweep.h"
+#include "metrics.h"
 
 /*check functions.h file for the default settings declared in struct arguments*/
 
@@ -22,110 +25,136 @@ int main(int argc, char** argv)
         {0, 'b', "BANDWTH", 0, "set the bandwidth, Hz"},
         {0, 'l', "LENGHT", 0, "set the L block lenght of measurements"},
         {0, 'n', "NUM_OF_BLOCKS", 0, "set the N number of blocks"},
-        {0, 'S', 0, 0, "see current settings"},
+        {0, 'S', 0, 0, "see current settings and the profiles in radar.conf"},
+        {0, 'r', "SECONDS|SIZE", 0, "record until Ctrl-C into a new FILE_NAME_YYYYMMDD_HHMMSSZ.iq (UTC) every SECONDS (also 10min or 1h, starting on multiples of it) or SIZE bytes (500M, 2G), with no gap between them"},
+        {0, 'Q', "SIZE", 0, "with -r: delete the oldest segments to keep them within SIZE bytes (300G, 1T)"},
+        {0, 'N', 0, 0, "send what is saved to the disk as it comes and keep it out of the page cache"},
+        {0, 'C', "PROFILE", 0, "run with the settings of PROFILE in radar.conf over those of [default], e.g. -C meteor-105.5MHz-2.4Msps"},
+        {0, 'U', 0, 0, "save the settings of this run (radar.conf, -C and the options given) as the -C profile, default [default], instead of measuring"},
+        {0, 'B', "BLOCKS", 0, "transform BLOCKS blocks per batched FFT plan (1 disables batching)"},
+        {0, 'j', "THREADS", 0, "average the spectrum on THREADS threads, 0 uses every core"},
+        {0, 'R', "BLOCKS", 0, "buffer up to BLOCKS blocks between the receiver and the disk"},
+        {0, 'L', "WINDOW", 0, "live mode: show a spectrum averaged over every WINDOW blocks until Ctrl-C, -o also records the iq counts"},
+        {0, 'D', 0, 0, "remove the DC offset of every block before the FFT"},
+        {0, 'W', "WINDOW", 0, "window of the Welch estimator: rect, hann (default), blackman-harris or flattop"},
+        {0, 'O', "PERCENT", 0, "overlap of the Welch segments: 0, 50 (default) or 75"},
+        {0, 'w', "BLOCKS", 0, "with -p: write a spectrogram of FILE_NAME to FILE_NAME.wf, BLOCKS blocks per row. -p FILE_NAME.wf shows it"},
+        {0, 'q', "FORMAT", 0, "values of the spectrogram: uint8 (default, 0.625 dB steps) or float16"},
+        {0, 'E', "OFFSET", 0, "with -L or -w: detect meteor echoes of the radar carrier OFFSET Hz from the center frequency, events go to FILE_NAME.events.csv"},
+        {0, 'T', "DB", 0, "echo detection threshold over the noise floor, dB (default 10)"},
+        {0, 'H', "HZ", 0, "look for echoes within HZ either side of the carrier (default 1000)"},
+        {0, 'd', "RATE", 0, "decimate to about RATE samples/sec before anything else, also what measure and -L record"},
+        {0, 'c', "OFFSET", 0, "move the channel OFFSET Hz from the center frequency to 0 Hz before decimating"},
+        {0, 'X', "OUTPUT_FILE_NAME", 0, "with -p and -d: also save the decimated capture to OUTPUT_FILE_NAME"},
+        {0, 'P', "PLANNER", 0, "FFTW planner: estimate, measure (default), patient or exhaustive"},
+        {0, 'V', "OUTPUT_FILE_NAME", 0, "with -p: copy FILE_NAME (an old .iq file or an unfinished capture) to a v2 .iq file OUTPUT_FILE_NAME"},
+        {0, 'A', "PATH", 0, "average every .iq file in the directory PATH, or matching the glob PATH, on -j workers. Spectra are cached in radar.cache, -o saves the summary table as csv"},
+        {0, 'Z', 0, 0, "code the iq counts that are saved losslessly, -p reads such files as any other"},
+        {0, 'I', "SOURCE", 0, "measure or -L from SOURCE: soapy (default, the receiver), synthetic (tones, noise and meteor echoes), FILE.iq (replay a capture) or loop:FILE.iq (replay it until -n blocks or Ctrl-C)"},
+        {0, 'x', "SPEED", 0, "deliver the samples of -I synthetic or a file at SPEED times real time (default 1), 0 as fast as they are taken"},
+        {0, 'F', "START:STOP[:STEP]", 0, "sweep from START to STOP Hz in steps of STEP (default 80% of the sample rate), or over the centers F1,F2,... Every step averages -n blocks, the spectra are stitched into one saved as csv (-o names it) and plotted"},
+        {0, 'G', "MS", 0, "drop MS milliseconds of samples after every retune of a sweep (default 20)"},
+        {0, 'M', "SERIAL,...", 0, "measure with every receiver in the list of serial numbers at once, all starting at one time. Receiver SERIAL is saved to FILE_NAME_SERIAL.iq"},
+        {0, 'm', "SECONDS", 0, "print the rates, ring use, losses and latencies of every stage every SECONDS, and where the time went at the end"},
+        {0, 'e', "ENDPOINT", 0, "serve the same metrics as Prometheus text over HTTP on 127.0.0.1:ENDPOINT, or on the Unix socket PATH for unix:PATH"},
+        {0, 'k', "START[:SECONDS]", 0, "with -p, -w or -V: only use SECONDS of the capture (default the rest) starting START seconds after its first block"},
         {0}
     };
     struct arguments arguments;
     struct argp argpStruct = {options, parse_opt};
 
-    /*load saved settings*/
-    std::fstream settingsFile;
-    settingsFile.open("settings.conf", std::ios::in);
-    if(settingsFile.is_open())
-    {
-        /*
-        a the file with the settings must follow this structure:
-        1st line. sample rate
-        2nd line. frequency
-        3rd line. gain
-        4th line. bandwidth
-        5ht line. size of each block
-        6th line. number of blocks    */
-        std::string setting;
-
-        /*there is no exception catching because file MUST have correct values*/
-
-        /*1st line*/
-        std::getline(settingsFile, setting);
-        arguments.sampleRate = std::stod(setting);
-
-        /*2nd line*/
-        std::getline(settingsFile, setting);
-        arguments.freq = std::stod(setting);
-
-        /*3rd line*/
-        std::getline(settingsFile, setting);
-        arguments.gain = std::stoi(setting);
-
-        /*4th line*/
-        std::getline(settingsFile, setting);
-        arguments.bandwidth = std::stoi(setting);
-
-        /*5th line*/
-        std::getline(settingsFile, setting);
-        arguments.blockLenght = std::stoi(setting);
-
-        /*6th line*/
-        std::getline(settingsFile, setting);
-        arguments.numberOfBlocks = std::stoi(setting);
+    /*Checking arguments:*/
+    argp_parse(&argpStruct, argc, argv, 0, 0, &arguments);
 
-        settingsFile.close();
-    }
-    else
+    /*radar.conf and the -C profile under the options of the command line, nothing is written here*/
+    try
     {
-        /*
-        file with settings doesn't exist. 
-        Create a new settings file and put default settings in it   */
-        std::cout << "Warning: Cannot find file with settings." << std::endl;
-        std::cout << "Creating a new one..." << std::endl;
-        try
+        loadSettings(arguments);
+        /*a -F range without a step is split by the rate of this run*/
+        if(arguments.sweep)
         {
-            saveSettingToFile(arguments);
-        }
-        catch(const std::exception& e)
-        {
-            std::cerr << e.what() << '\n';
+            sweepPlan(arguments.sweepSpec, arguments.sampleRate);
         }
     }
-    
-    /*Checking arguments:*/
-    argp_parse(&argpStruct, argc, argv, 0, 0, &arguments);
+    catch(const std::exception& e)
+    {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
 
     /*need to set default file name*/
     if(!arguments.customFileName)
     {
-        arguments.fileName = getTimeString() + "_results.iq";
+        /*segments are named after their own start*/
+        arguments.fileName = arguments.segmentSeconds > 0 || arguments.segmentBytes > 0 ? "radar.iq"
+                                                                                       : getTimeString() + "_results.iq";
     }
     
     /*show settings*/
     if(arguments.showSettings)
     {
-        std::cout << "Current sample rate: " << static_cast<long>(arguments.sampleRate) << " samples/sec" << std::endl;
-        std::cout << "Current frequency: " << static_cast<long>(arguments.freq) << " Hz" << std::endl;
-        std::cout << "Current gain: " << arguments.gain << " dB" << std::endl;
-        std::cout << "Current bandwidth: " << arguments.bandwidth << " Hz" << std::endl;
-        std::cout << "Current block lenght: " << arguments.blockLenght << " values" << std::endl;
-        std::cout << "Current number of blocks: " << arguments.numberOfBlocks << std::endl;
+        try
+        {
+            showSettings(arguments, std::cout);
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+        }
     }
 
     /*saving the settings*/
-    if(arguments.settingsUpdated)
+    if(arguments.saveProfile)
     {
         try
         {
-            saveSettingToFile(arguments);
+            saveSettings(arguments);
         }
         catch(const std::exception& e)
         {
             std::cerr << e.what() << '\n';
+            return 1;
         }
     }
     
+    /*metrics of whatever runs below, until the end of main*/
+#ifndef RADAR_METRICS
+    if(arguments.metricsSeconds > 0 || !arguments.metricsEndpoint.empty())
+    {
+        std::cout << "Warning: built without RADAR_METRICS, there are no metrics to show" << std::endl;
+    }
+#endif
+    std::unique_ptr<MetricsServer> metricsServer;
+    if(!arguments.metricsEndpoint.empty())
+    {
+        try
+        {
+            metricsServer.reset(new MetricsServer(arguments.metricsEndpoint));
+            std::cout << "Metrics are served on " << arguments.metricsEndpoint << std::endl;
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+        }
+    }
+    std::unique_ptr<MetricsReporter> metricsReporter;
+    if(arguments.metricsSeconds > 0)
+    {
+        metricsReporter.reset(new MetricsReporter(arguments.metricsSeconds, std::cout));
+    }
+
     if(arguments.measure)
     {
         try
         {
-            measure(arguments);
+            if(arguments.deviceSerials.empty())
+            {
+                measure(arguments);
+            }
+            else
+            {
+                measureDevices(arguments);
+            }
         }
         catch(const std::exception& e)
         {
@@ -134,12 +163,59 @@ int main(int argc, char** argv)
         
     }
 
+    if(arguments.live)
+    {
+        try
+        {
+            live(arguments);
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+        }
+    }
+
+    if(arguments.sweep)
+    {
+        try
+        {
+            sweep(arguments);
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+        }
+    }
+
+    if(arguments.batch)
+    {
+        try
+        {
+            batch(arguments);
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+        }
+    }
+
     /*plot the graph*/
     if(arguments.plot)
     {
         try
         {
-            plot(arguments);
+            if(!arguments.convertFileName.empty())
+            {
+                convert(arguments);
+            }
+            else if(arguments.waterfallBlocks > 0)
+            {
+                spectrogram(arguments);
+            }
+            else
+            {
+                plot(arguments);
+            }
         }
         catch(const std::exception& e)
         {
@@ -0,0 +1,349 @@
+#include <cmath>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "metrics.h"
+
+/*how long the server and the reporter take to notice they are stopped*/
+constexpr int metricsPollMs = 200;
+
+static const char* counterNames[] =
+{
+    "samples_received", "short_reads", "timeouts", "overflows",
+    "stream_errors", "ring_overruns", "discontinuities", "dropped_samples"
+};
+static const char* gaugeNames[] = {"ring_occupancy_blocks", "ring_capacity_blocks", "ring_high_water_blocks"};
+
+const char* stageName(Stage stage)
+{
+    static const char* names[] = {"read", "write", "encode", "decode", "decimate", "convert", "fft", "accumulate"};
+    return names[static_cast<int>(stage)];
+}
+
+Metrics& metrics()
+{
+    static Metrics instance;
+    return instance;
+}
+
+void Metrics::record(Stage stage, uint64_t ns)
+{
+    Histogram& h = stages[static_cast<int>(stage)];
+    int bucket = 0;
+    for(uint64_t rest = ns >> 1; rest != 0 && bucket < histogramBuckets - 1; rest >>= 1)
+    {
+        bucket++;
+    }
+    h.calls.fetch_add(1, std::memory_order_relaxed);
+    h.totalNs.fetch_add(static_cast<long long>(ns), std::memory_order_relaxed);
+    h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::raise(Gauge gauge, long long value)
+{
+    std::atomic<long long>& g = gauges[static_cast<int>(gauge)];
+    long long current = g.load(std::memory_order_relaxed);
+    while(value > current && !g.compare_exchange_weak(current, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+long long Metrics::calls(Stage stage) const
+{
+    return stages[static_cast<int>(stage)].calls.load(std::memory_order_relaxed);
+}
+
+long long Metrics::totalNs(Stage stage) const
+{
+    return stages[static_cast<int>(stage)].totalNs.load(std::memory_order_relaxed);
+}
+
+double Metrics::quantileNs(Stage stage, double fraction) const
+{
+    const Histogram& h = stages[static_cast<int>(stage)];
+    long long counts[histogramBuckets];
+    long long total = 0;
+    for(int b = 0; b < histogramBuckets; b++)
+    {
+        counts[b] = h.buckets[b].load(std::memory_order_relaxed);
+        total += counts[b];
+    }
+    /*the middle of the bucket the quantile falls in, so at most a third off*/
+    long long seen = 0;
+    for(int b = 0; b < histogramBuckets; b++)
+    {
+        seen += counts[b];
+        if(total > 0 && seen >= fraction * total)
+        {
+            return 1.5 * std::ldexp(1.0, b);
+        }
+    }
+    return 0;
+}
+
+std::string Metrics::prometheusText() const
+{
+    std::ostringstream text;
+    for(int c = 0; c < static_cast<int>(Counter::count); c++)
+    {
+        text << "# TYPE radar_" << counterNames[c] << "_total counter\n"
+             << "radar_" << counterNames[c] << "_total " << value(static_cast<Counter>(c)) << '\n';
+    }
+    for(int g = 0; g < static_cast<int>(Gauge::count); g++)
+    {
+        text << "# TYPE radar_" << gaugeNames[g] << " gauge\n"
+             << "radar_" << gaugeNames[g] << ' ' << value(static_cast<Gauge>(g)) << '\n';
+    }
+    text << "# TYPE radar_stage_seconds histogram\n";
+    for(int s = 0; s < static_cast<int>(Stage::count); s++)
+    {
+        const Histogram& h = stages[s];
+        const std::string stage = std::string{"stage=\""} + stageName(static_cast<Stage>(s)) + "\"";
+        long long cumulative = 0;
+        for(int b = 0; b < histogramBuckets - 1; b++)
+        {
+            cumulative += h.buckets[b].load(std::memory_order_relaxed);
+            /*below a microsecond only the total is of interest*/
+            if(b >= 9)
+            {
+                text << "radar_stage_seconds_bucket{" << stage << ",le=\"" << std::ldexp(1.0, b + 1) / 1e9 << "\"} "
+                     << cumulative << '\n';
+            }
+        }
+        cumulative += h.buckets[histogramBuckets - 1].load(std::memory_order_relaxed);
+        text << "radar_stage_seconds_bucket{" << stage << ",le=\"+Inf\"} " << cumulative << '\n'
+             << "radar_stage_seconds_sum{" << stage << "} " << h.totalNs.load(std::memory_order_relaxed) / 1e9 << '\n'
+             << "radar_stage_seconds_count{" << stage << "} " << cumulative << '\n';
+    }
+    return text.str();
+}
+
+/*1.2ms, 35us or 800ns*/
+static std::string duration(double ns)
+{
+    std::ostringstream text;
+    text << std::setprecision(3);
+    if(ns >= 1e6)
+    {
+        text << ns / 1e6 << "ms";
+    }
+    else if(ns >= 1e3)
+    {
+        text << ns / 1e3 << "us";
+    }
+    else
+    {
+        text << ns << "ns";
+    }
+    return text.str();
+}
+
+MetricsReporter::MetricsReporter(double seconds, std::ostream& out)
+    : seconds(seconds), out(out)
+{
+    thread = std::thread(&MetricsReporter::run, this);
+}
+
+MetricsReporter::~MetricsReporter()
+{
+    stop = true;
+    thread.join();
+
+    const Metrics& m = metrics();
+    out << "Stage         calls        total      mean       p50       p99" << std::endl;
+    for(int s = 0; s < static_cast<int>(Stage::count); s++)
+    {
+        const Stage stage = static_cast<Stage>(s);
+        const long long calls = m.calls(stage);
+        if(calls == 0)
+        {
+            continue;
+        }
+        out << std::left << std::setw(12) << stageName(stage) << std::right << std::setw(8) << calls
+            << std::setw(12) << duration(static_cast<double>(m.totalNs(stage)))
+            << std::setw(10) << duration(static_cast<double>(m.totalNs(stage)) / calls)
+            << std::setw(10) << duration(m.quantileNs(stage, 0.5))
+            << std::setw(10) << duration(m.quantileNs(stage, 0.99)) << std::endl;
+    }
+}
+
+void MetricsReporter::run()
+{
+    const Metrics& m = metrics();
+    const auto start = std::chrono::steady_clock::now();
+    auto last = start;
+    long long lastSamples = m.value(Counter::samplesReceived);
+    while(!stop)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::max(1, std::min(metricsPollMs, static_cast<int>(seconds * 1e3)))));
+        const auto now = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double>(now - last).count();
+        if(stop || elapsed < seconds)
+        {
+            continue;
+        }
+        const long long samples = m.value(Counter::samplesReceived);
+        std::ostringstream line;
+        line << "[" << std::fixed << std::setprecision(1) << std::chrono::duration<double>(now - start).count() << " s]";
+        /*rates and losses of the receiving side, the stages alone when a file is read*/
+        if(m.value(Gauge::ringCapacity) > 0)
+        {
+            line << " " << std::setprecision(2) << (samples - lastSamples) / elapsed / 1e6 << " Msamples/s";
+            line.unsetf(std::ios::floatfield);
+            line << ", ring " << m.value(Gauge::ringOccupancy) << "/" << m.value(Gauge::ringCapacity)
+                 << " (max " << m.value(Gauge::ringHighWater) << "), overflows " << m.value(Counter::overflows)
+                 << ", overruns " << m.value(Counter::ringOverruns) << ", dropped " << m.value(Counter::droppedSamples);
+        }
+        for(int s = 0; s < static_cast<int>(Stage::count); s++)
+        {
+            const Stage stage = static_cast<Stage>(s);
+            if(m.calls(stage) > 0)
+            {
+                line << " | " << stageName(stage) << " p50 " << duration(m.quantileNs(stage, 0.5))
+                     << " p99 " << duration(m.quantileNs(stage, 0.99));
+            }
+        }
+        out << line.str() << std::endl;
+        last = now;
+        lastSamples = samples;
+    }
+}
+
+MetricsServer::MetricsServer(const std::string& endpoint)
+{
+    if(endpoint.compare(0, 5, "unix:") == 0)
+    {
+        socketPath = endpoint.substr(5);
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        if(socketPath.empty() || socketPath.size() >= sizeof(address.sun_path))
+        {
+            throw std::runtime_error{"Invalid metrics socket path " + socketPath};
+        }
+        address.sun_family = AF_UNIX;
+        std::strcpy(address.sun_path, socketPath.c_str());
+        /*only a socket left by an earlier run is replaced, never a file a typo pointed at*/
+        struct stat status;
+        if(lstat(socketPath.c_str(), &status) == 0)
+        {
+            if(!S_ISSOCK(status.st_mode))
+            {
+                throw std::runtime_error{"Cannot serve metrics on " + socketPath + ", the path exists"};
+            }
+            unlink(socketPath.c_str());
+        }
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            if(listenFd >= 0)
+            {
+                close(listenFd);
+            }
+            throw std::runtime_error{"Cannot serve metrics on " + socketPath};
+        }
+    }
+    else
+    {
+        int port = 0;
+        try
+        {
+            size_t used = 0;
+            port = std::stoi(endpoint, &used);
+            if(used != endpoint.size())
+            {
+                port = 0;
+            }
+        }
+        catch(const std::exception&)
+        {
+        }
+        if(port <= 0 || port > 65535)
+        {
+            throw std::runtime_error{"Metrics endpoint must be a port or unix:PATH, not " + endpoint};
+        }
+        /*local only, the numbers are not meant for the network*/
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        const int reuse = 1;
+        if(listenFd >= 0)
+        {
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        }
+        if(listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            if(listenFd >= 0)
+            {
+                close(listenFd);
+            }
+            throw std::runtime_error{"Cannot serve metrics on 127.0.0.1:" + endpoint};
+        }
+    }
+    if(listen(listenFd, 8) != 0)
+    {
+        close(listenFd);
+        throw std::runtime_error{"Cannot serve metrics on " + endpoint};
+    }
+    thread = std::thread(&MetricsServer::run, this);
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop = true;
+    thread.join();
+    close(listenFd);
+    if(!socketPath.empty())
+    {
+        unlink(socketPath.c_str());
+    }
+}
+
+void MetricsServer::run()
+{
+    while(!stop)
+    {
+        pollfd waiting = {listenFd, POLLIN, 0};
+        if(poll(&waiting, 1, metricsPollMs) <= 0)
+        {
+            continue;
+        }
+        const int client = accept(listenFd, nullptr, nullptr);
+        if(client < 0)
+        {
+            continue;
+        }
+        /*whatever was asked, the answer is the metrics; the request is only drained*/
+        char request[1024];
+        pollfd reading = {client, POLLIN, 0};
+        if(poll(&reading, 1, metricsPollMs) > 0)
+        {
+            recv(client, request, sizeof(request), 0);
+        }
+        const std::string body = metrics().prometheusText();
+        const std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                                     std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        for(size_t sent = 0; sent < response.size();)
+        {
+            const ssize_t n = send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if(n <= 0)
+            {
+                break;
+            }
+            sent += n;
+        }
+        close(client);
+    }
+}
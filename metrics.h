@@ -0,0 +1,158 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <ostream>
+
+/*parts of the pipeline that are timed, every call of one goes to its histogram*/
+enum class Stage
+{
+    read,           //waiting for the next block of the source, readStream for a receiver
+    write,          //IqWriter::write, coding included
+    encode,
+    decode,
+    decimate,
+    convert,        //int8 counts to windowed floats before the FFT
+    fft,
+    accumulate,     //|X|^2 summed into the average
+    count
+};
+
+/*totals of every receiver, the same events AcquisitionStats counts per run*/
+enum class Counter
+{
+    samplesReceived,
+    shortReads,
+    timeouts,
+    overflows,
+    streamErrors,
+    ringOverruns,
+    discontinuities,
+    droppedSamples,
+    count
+};
+
+/*last value of the ring that was published last, the high-water mark of any ring*/
+enum class Gauge
+{
+    ringOccupancy,
+    ringCapacity,
+    ringHighWater,
+    count
+};
+
+/*bucket b counts the calls that took [2^b, 2^(b+1)) ns, the last one everything longer*/
+constexpr int histogramBuckets = 40;
+
+/*
+process-wide counters and latency histograms. Every update is one relaxed
+atomic add or store, so the stages can record from any thread without locks,
+and readers see values that are at most a few updates old */
+class Metrics
+{
+public:
+    void record(Stage stage, uint64_t ns);
+    void add(Counter counter, long long value) { counters[static_cast<int>(counter)].fetch_add(value, std::memory_order_relaxed); }
+    void set(Gauge gauge, long long value) { gauges[static_cast<int>(gauge)].store(value, std::memory_order_relaxed); }
+    void raise(Gauge gauge, long long value);
+
+    long long calls(Stage stage) const;
+    long long totalNs(Stage stage) const;
+    /*latency below which `fraction` of the calls finished, ns, estimated from the buckets*/
+    double quantileNs(Stage stage, double fraction) const;
+    long long value(Counter counter) const { return counters[static_cast<int>(counter)].load(std::memory_order_relaxed); }
+    long long value(Gauge gauge) const { return gauges[static_cast<int>(gauge)].load(std::memory_order_relaxed); }
+
+    /*Prometheus text exposition format, version 0.0.4*/
+    std::string prometheusText() const;
+
+private:
+    struct Histogram
+    {
+        std::atomic<long long> calls{0};
+        std::atomic<long long> totalNs{0};
+        std::atomic<long long> buckets[histogramBuckets] = {};
+    };
+    Histogram stages[static_cast<int>(Stage::count)];
+    std::atomic<long long> counters[static_cast<int>(Counter::count)] = {};
+    std::atomic<long long> gauges[static_cast<int>(Gauge::count)] = {};
+};
+
+Metrics& metrics();
+const char* stageName(Stage stage);
+
+/*
+hot path hooks. Built with RADAR_METRICS (cmake -DRADAR_METRICS=OFF leaves it
+out) a timer reads the clock when it is made and when it goes out of scope;
+without it the hooks compile to nothing */
+#ifdef RADAR_METRICS
+class StageTimer
+{
+public:
+    explicit StageTimer(Stage stage) : stage(stage), start(std::chrono::steady_clock::now()) {}
+    ~StageTimer()
+    {
+        metrics().record(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+};
+#define METRICS_TIME(stage) StageTimer stageTimer(stage)
+#define METRICS_ADD(counter, value) metrics().add(counter, value)
+#define METRICS_SET(gauge, value) metrics().set(gauge, value)
+#define METRICS_RAISE(gauge, value) metrics().raise(gauge, value)
+#else
+#define METRICS_TIME(stage)
+#define METRICS_ADD(counter, value)
+#define METRICS_SET(gauge, value)
+#define METRICS_RAISE(gauge, value)
+#endif
+
+/*
+one line of rates, ring use and stage latencies (since the start) every
+`seconds`, a table of the time spent in every stage when it is destroyed */
+class MetricsReporter
+{
+public:
+    MetricsReporter(double seconds, std::ostream& out);
+    ~MetricsReporter();
+    MetricsReporter(const MetricsReporter&) = delete;
+    MetricsReporter& operator=(const MetricsReporter&) = delete;
+
+private:
+    void run();
+
+    double seconds;
+    std::ostream& out;
+    std::atomic<bool> stop{false};
+    std::thread thread;
+};
+
+/*
+serves metrics().prometheusText() over HTTP to any request, on 127.0.0.1:PORT
+for "PORT" or on the Unix socket PATH for "unix:PATH" */
+class MetricsServer
+{
+public:
+    explicit MetricsServer(const std::string& endpoint);
+    ~MetricsServer();
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+private:
+    void run();
+
+    int listenFd = -1;
+    std::string socketPath;
+    std::atomic<bool> stop{false};
+    std::thread thread;
+};
+
+#endif
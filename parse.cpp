@@ -0,0 +1,52 @@
+#include <cmath>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include "parse.h"
+
+static double parseNumber(const std::string& text)
+{
+    size_t used = 0;
+    double value = 0;
+    try
+    {
+        value = std::stod(text, &used);
+    }
+    catch(const std::exception&)
+    {
+        used = 0;
+    }
+    if(used == 0 || used != text.size() || !std::isfinite(value))
+    {
+        throw std::invalid_argument{"\"" + text + "\" is not a number"};
+    }
+    return value;
+}
+
+int parseInteger(const std::string& text, double low, double high)
+{
+    const double value = parseNumber(text);
+    if(value != std::floor(value))
+    {
+        throw std::invalid_argument{"\"" + text + "\" is not a whole number"};
+    }
+    if(value < low || value > high)
+    {
+        std::ostringstream range;
+        range << "\"" << text << "\" is not within " << std::setprecision(15) << low << " to " << high;
+        throw std::invalid_argument{range.str()};
+    }
+    return static_cast<int>(value);
+}
+
+double parseRange(const std::string& text, double low, double high)
+{
+    const double value = parseNumber(text);
+    if(value < low || value > high)
+    {
+        std::ostringstream range;
+        range << "\"" << text << "\" is not within " << std::setprecision(15) << low << " to " << high;
+        throw std::invalid_argument{range.str()};
+    }
+    return value;
+}
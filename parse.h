@@ -0,0 +1,12 @@
+#ifndef _PARSE_H
+#define _PARSE_H
+
+#include <string>
+
+/*
+the whole of `text` as a number within [low, high], throws std::invalid_argument
+saying what is wrong. parseInteger takes 1e6 as well as 1000000, not a fraction */
+double parseRange(const std::string& text, double low, double high);
+int parseInteger(const std::string& text, double low, double high);
+
+#endif
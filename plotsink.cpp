@@ -0,0 +1,87 @@
+#include <chrono>
+#include <algorithm>
+#include "plotsink.h"
+
+PlotSink::PlotSink(double maxFramesPerSecond, const std::string& title)
+    : title(title), minIntervalSec(maxFramesPerSecond > 0 ? 1.0 / maxFramesPerSecond : 0.0)
+{
+    /*settings are sent once, every frame only carries the plot command and data*/
+    gp << "set nokey\n";
+    gp << "set grid\n";
+    gp << "set title '" << title << "'\n";
+    gp << "set xlabel 'Frequency, MHz'\n";
+    gp << "set ylabel 'dBFS/Hz'\n";
+    gp << "set autoscale xfixmin\n";
+    gp << "set autoscale xfixmax\n";
+    worker = std::thread(&PlotSink::run, this);
+}
+
+PlotSink::~PlotSink()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cv.notify_one();
+    worker.join();
+}
+
+void PlotSink::submit(const std::vector<double>& x, const std::vector<double>& y)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(hasPending)
+        {
+            skipped++;
+        }
+        pending.resize(std::min(x.size(), y.size()));
+        for(size_t i = 0; i < pending.size(); i++)
+        {
+            pending[i] = std::make_pair(x[i], y[i]);
+        }
+        hasPending = true;
+    }
+    cv.notify_one();
+}
+
+void PlotSink::run()
+{
+    std::vector<std::pair<double, double>> frame;
+    auto nextAllowed = std::chrono::steady_clock::now();
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return hasPending || stop; });
+            if(!hasPending)
+            {
+                break;
+            }
+            frame.swap(pending);
+            hasPending = false;
+        }
+
+        /*talking to gnuplot happens outside the lock*/
+        send(frame);
+        shown++;
+
+        /*frames arriving until then are merged into the latest one*/
+        nextAllowed += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                           std::chrono::duration<double>(minIntervalSec));
+        auto now = std::chrono::steady_clock::now();
+        if(nextAllowed < now)
+        {
+            nextAllowed = now;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait_until(lock, nextAllowed, [this]() { return stop; });
+    }
+}
+
+void PlotSink::send(const std::vector<std::pair<double, double>>& frame)
+{
+    /*binary x, y records instead of one text line per point*/
+    gp << "plot '-' binary" << gp.binFmt1d(frame, "record") << " with lines\n";
+    gp.sendBinary1d(frame);
+    gp.flush();
+}
@@ -0,0 +1,52 @@
+#ifndef _PLOTSINK_H
+#define _PLOTSINK_H
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <condition_variable>
+#include <gnuplot-iostream.h>
+
+/*
+one gnuplot process for the whole run. Frames are sent in binary by
+a background thread at most maxFramesPerSecond times a second, frames
+submitted in between replace the waiting one, so a slow gnuplot
+never holds back the caller   */
+class PlotSink
+{
+public:
+    explicit PlotSink(double maxFramesPerSecond = 10, const std::string& title = "Spectrum");
+    /*shows the last submitted frame before closing*/
+    ~PlotSink();
+    PlotSink(const PlotSink&) = delete;
+    PlotSink& operator=(const PlotSink&) = delete;
+
+    /*copy the frame (y over x) and return at once*/
+    void submit(const std::vector<double>& x, const std::vector<double>& y);
+
+    long long framesShown() const { return shown; }
+    long long framesSkipped() const { return skipped; }
+
+private:
+    void run();
+    void send(const std::vector<std::pair<double, double>>& frame);
+
+    Gnuplot gp;
+    std::string title;
+    double minIntervalSec;
+    /*counted on the worker and by submit(), read from any thread*/
+    std::atomic<long long> shown{0};
+    std::atomic<long long> skipped{0};
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::pair<double, double>> pending;
+    bool hasPending = false;
+    bool stop = false;
+    std::thread worker;
+};
+
+#endif
@@ -0,0 +1,357 @@
+#include <cmath>
+#include <cctype>
+#include <ctime>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <glob.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "recorder.h"
+
+std::string timeString(long long unixNs, bool utc)
+{
+    const time_t seconds = static_cast<time_t>(unixNs / 1000000000);
+    tm time;
+    if(utc)
+    {
+        gmtime_r(&seconds, &time);
+    }
+    else
+    {
+        localtime_r(&seconds, &time);
+    }
+    char text[32];
+    strftime(text, sizeof(text), "%Y%m%d_%H%M%S", &time);
+    return text;
+}
+
+/*the number in front of the unit, which is returned in `unit`*/
+static double splitUnit(const std::string& text, std::string& unit)
+{
+    size_t used = 0;
+    double value = 0;
+    try
+    {
+        value = std::stod(text, &used);
+    }
+    catch(const std::exception&)
+    {
+        used = 0;
+    }
+    if(used == 0 || !std::isfinite(value) || value <= 0)
+    {
+        throw std::invalid_argument{"\"" + text + "\" does not start with a number over 0"};
+    }
+    unit = text.substr(used);
+    return value;
+}
+
+static bool byteUnit(const std::string& unit, double& scale)
+{
+    const char* units[] = {"B", "K", "M", "G", "T"};
+    for(int i = 0; i < 5; i++)
+    {
+        if(unit == units[i])
+        {
+            scale = std::ldexp(1.0, 10 * i);
+            return true;
+        }
+    }
+    return false;
+}
+
+long long parseBytes(const std::string& text)
+{
+    std::string unit;
+    const double value = splitUnit(text, unit);
+    double scale = 1;
+    if(!unit.empty() && !byteUnit(unit, scale))
+    {
+        throw std::invalid_argument{"\"" + text + "\" is not a size, units are B, K, M, G and T"};
+    }
+    return std::llround(value * scale);
+}
+
+void parseSegmentLimit(const std::string& text, SegmentSettings& settings)
+{
+    std::string unit;
+    const double value = splitUnit(text, unit);
+    double scale = 1;
+    if(byteUnit(unit, scale))
+    {
+        settings.bytes = std::llround(value * scale);
+        settings.seconds = 0;
+        if(settings.bytes < static_cast<long long>(iqFileHeaderSize + iqIndexEntrySize))
+        {
+            throw std::invalid_argument{"\"" + text + "\" cannot hold a single block"};
+        }
+        return;
+    }
+    if(unit.empty() || unit == "s")
+    {
+        scale = 1;
+    }
+    else if(unit == "min")
+    {
+        scale = 60;
+    }
+    else if(unit == "h")
+    {
+        scale = 3600;
+    }
+    else
+    {
+        throw std::invalid_argument{"\"" + text + "\" is neither a time (s, min, h) nor a size (B, K, M, G, T)"};
+    }
+    settings.seconds = value * scale;
+    settings.bytes = 0;
+}
+
+std::string formatBytes(long long bytes)
+{
+    const char* units[] = {"B", "K", "M", "G", "T"};
+    int unit = 0;
+    while(unit < 4 && bytes != 0 && bytes % 1024 == 0)
+    {
+        bytes /= 1024;
+        unit++;
+    }
+    return std::to_string(bytes) + units[unit];
+}
+
+static long long fileSize(const std::string& fileName)
+{
+    struct stat status;
+    return stat(fileName.c_str(), &status) == 0 ? static_cast<long long>(status.st_size) : 0;
+}
+
+/*what follows PREFIX_ in the name of a segment: YYYYMMDD_HHMMSSZ.iq or YYYYMMDD_HHMMSSZ_N.iq*/
+static bool isSegmentSuffix(const std::string& suffix)
+{
+    const char* shape = "dddddddd_ddddddZ";
+    size_t i = 0;
+    for(; shape[i] != '\0'; i++)
+    {
+        if(i >= suffix.size() ||
+           (shape[i] == 'd' ? !std::isdigit(static_cast<unsigned char>(suffix[i])) : suffix[i] != shape[i]))
+        {
+            return false;
+        }
+    }
+    if(i < suffix.size() && suffix[i] == '_')
+    {
+        const size_t digits = ++i;
+        while(i < suffix.size() && std::isdigit(static_cast<unsigned char>(suffix[i])))
+        {
+            i++;
+        }
+        if(i == digits)
+        {
+            return false;
+        }
+    }
+    return suffix.compare(i, std::string::npos, ".iq") == 0;
+}
+
+/*`text` matched literally by glob()*/
+static std::string escapeGlob(const std::string& text)
+{
+    std::string escaped;
+    for(char c : text)
+    {
+        if(c == '*' || c == '?' || c == '[' || c == ']' || c == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+SegmentRecorder::SegmentRecorder(const std::string& prefix, const IqHeader& header, const SegmentSettings& settings)
+    : prefix(prefix), header(header), settings(settings)
+{
+    if(settings.seconds <= 0 && settings.bytes <= 0)
+    {
+        throw std::invalid_argument{"A segment needs a lenght in seconds or bytes"};
+    }
+    /*
+    segments of earlier runs count against the budget too, their names sort by
+    time. Only names of exactly that shape, so the files of other receivers
+    (PREFIX_SERIAL_...) or anything else starting with the prefix are never deleted */
+    glob_t matches;
+    if(glob((escapeGlob(prefix) + "_*.iq").c_str(), 0, nullptr, &matches) == 0)
+    {
+        for(size_t i = 0; i < matches.gl_pathc; i++)
+        {
+            const std::string fileName = matches.gl_pathv[i];
+            if(isSegmentSuffix(fileName.substr(prefix.size() + 1)))
+            {
+                closed.emplace_back(fileName, fileSize(fileName));
+            }
+        }
+    }
+    globfree(&matches);
+}
+
+SegmentRecorder::~SegmentRecorder()
+{
+    close();
+}
+
+bool SegmentRecorder::write(const std::complex<int8_t>* samples, long long timeNs, int flags)
+{
+    const long long blockBytes = header.blockLenght * static_cast<long long>(sizeof(std::complex<int8_t>));
+    const bool timeIsUp = settings.seconds > 0 && positionNs >= nextBoundaryNs;
+    /*a coded block is never larger than an uncoded one, so the next one surely fits*/
+    const bool fileIsFull = settings.bytes > 0 && current && currentBlocks > 0 &&
+        static_cast<long long>(iqFileHeaderSize) + current->bytes() + (currentBlocks + 1) * static_cast<long long>(iqIndexEntrySize) + blockBytes > settings.bytes;
+    if(openFailed)
+    {
+        return false;
+    }
+    if(!current || timeIsUp || fileIsFull)
+    {
+        try
+        {
+            roll();
+        }
+        catch(const std::exception& e)
+        {
+            /*like a failed write of one file, the blocks after it are not saved*/
+            std::cerr << e.what() << std::endl;
+            openFailed = true;
+            return false;
+        }
+    }
+    const bool written = current->write(samples, timeNs, flags);
+    currentBlocks++;
+    blocksWritten++;
+    positionNs = startNs + std::llround(blocksWritten * static_cast<double>(header.blockLenght) * 1e9 / header.sampleRate);
+    return written;
+}
+
+long long SegmentRecorder::segmentBlocks() const
+{
+    const long long blockBytes = header.blockLenght * static_cast<long long>(sizeof(std::complex<int8_t>));
+    long long blocks = -1;
+    if(settings.seconds > 0)
+    {
+        blocks = static_cast<long long>(std::ceil((nextBoundaryNs - positionNs) * 1e-9 * header.sampleRate / header.blockLenght));
+    }
+    if(settings.bytes > 0)
+    {
+        const long long fit = (settings.bytes - static_cast<long long>(iqFileHeaderSize)) / (blockBytes + static_cast<long long>(iqIndexEntrySize));
+        blocks = blocks < 0 ? fit : std::min(blocks, fit);
+    }
+    return std::max(1LL, blocks);
+}
+
+void SegmentRecorder::roll()
+{
+    if(!current)
+    {
+        startNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        positionNs = startNs;
+    }
+    if(settings.seconds > 0)
+    {
+        const long long periodNs = std::max(1LL, std::llround(settings.seconds * 1e9));
+        nextBoundaryNs = (positionNs / periodNs + 1) * periodNs;
+    }
+
+    /*two segments within one second, or one left by an earlier run, get a number*/
+    const std::string base = prefix + "_" + timeString(positionNs, true) + "Z";
+    std::string fileName = base + ".iq";
+    for(int n = 1; fileName == currentName || access(fileName.c_str(), F_OK) == 0; n++)
+    {
+        fileName = base + "_" + std::to_string(n) + ".iq";
+    }
+
+    IqHeader segment = header;
+    segment.numberOfBlocks = segmentBlocks();
+    IqWriteOptions options;
+    options.preallocateBytes = iqFileBytes(segment, segment.numberOfBlocks);
+    options.dropCache = settings.dropCache;
+    std::unique_ptr<IqWriter> next(new IqWriter(fileName, segment, options));
+
+    /*the next segment is open before the last one is closed, the writer thread does not wait for either*/
+    if(closer.joinable())
+    {
+        closer.join();
+    }
+    std::unique_ptr<IqWriter> previous = std::move(current);
+    const std::string previousName = currentName;
+    if(previous)
+    {
+        closedBytes += previous->bytes();
+    }
+    current = std::move(next);
+    currentName = fileName;
+    currentBlocks = 0;
+    segmentCount++;
+    const long long reservedBytes = options.preallocateBytes;
+    IqWriter* closing = previous.release();
+    closer = std::thread([this, closing, previousName, reservedBytes]()
+    {
+        finish(std::unique_ptr<IqWriter>(closing), previousName, reservedBytes);
+    });
+}
+
+void SegmentRecorder::finish(std::unique_ptr<IqWriter> writer, std::string fileName, long long reservedBytes)
+{
+    if(writer)
+    {
+        writer->close();
+        if(writer->failed())
+        {
+            closeFailed = true;
+            std::cerr << "Writing to " << fileName << " failed" << std::endl;
+        }
+        closed.emplace_back(fileName, fileSize(fileName));
+        std::cout << "Segment " << fileName << ": " << writer->blocks() << " blocks" << std::endl;
+    }
+    prune(reservedBytes);
+}
+
+void SegmentRecorder::prune(long long reservedBytes)
+{
+    if(settings.budgetBytes <= 0)
+    {
+        return;
+    }
+    long long total = reservedBytes;
+    for(const auto& segment : closed)
+    {
+        total += segment.second;
+    }
+    while(total > settings.budgetBytes && !closed.empty())
+    {
+        const std::string& oldest = closed.front().first;
+        std::remove(oldest.c_str());
+        std::remove((oldest + ".idx").c_str());
+        std::cout << "Deleted " << oldest << " to stay within " << formatBytes(settings.budgetBytes) << std::endl;
+        total -= closed.front().second;
+        closed.pop_front();
+    }
+    if(total > settings.budgetBytes)
+    {
+        std::cout << "Warning: one segment is larger than the disk budget of " << formatBytes(settings.budgetBytes) << std::endl;
+    }
+}
+
+void SegmentRecorder::close()
+{
+    if(closer.joinable())
+    {
+        closer.join();
+    }
+    if(current)
+    {
+        closedBytes += current->bytes();
+        finish(std::move(current), currentName, 0);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef _RECORDER_H
+#define _RECORDER_H
+
+#include <string>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <utility>
+#include "iqfile.h"
+
+/*when a recording moves on to its next segment and how much of the disk it may take*/
+struct SegmentSettings
+{
+    double seconds = 0;             //segment lenght, they start on multiples of it in UTC. 0 rolls over by size only
+    long long bytes = 0;            //largest segment file, 0 rolls over by time only
+    long long budgetBytes = 0;      //oldest segments of the same prefix are deleted to stay under it, 0 keeps all
+    bool dropCache = false;         //see IqWriteOptions
+};
+
+/*YYYYMMDD_HHMMSS of `unixNs` ns since the epoch, zero padded, so names sort by time*/
+std::string timeString(long long unixNs, bool utc);
+
+/*"600", "90s", "10min" or "6h" set seconds, "500M", "2G" or "1073741824B" bytes. Throws std::invalid_argument*/
+void parseSegmentLimit(const std::string& text, SegmentSettings& settings);
+/*"300G", "1T" or "1048576B", K, M, G and T are powers of 1024. Throws std::invalid_argument*/
+long long parseBytes(const std::string& text);
+/*the other way round, in the largest unit that is exact*/
+std::string formatBytes(long long bytes);
+
+/*
+a recording without an end as a series of .iq files PREFIX_YYYYMMDD_HHMMSSZ.iq,
+named after the UTC time of their first sample. The next segment starts with
+the block after the last one of the previous, so nothing is lost in between.
+Every segment is preallocated for its expected size. Closing a segment (its
+index is copied behind the counts) and pruning old ones to the disk budget run
+on a thread of their own, the writer thread only opens the next file.
+
+Times are counted from the samples, starting at the host time of the first
+block, so a segment holds exactly its share of them; a receiver clock off
+by 10 ppm moves the boundaries by about a second a day */
+class SegmentRecorder : public BlockSink
+{
+public:
+    SegmentRecorder(const std::string& prefix, const IqHeader& header, const SegmentSettings& settings);
+    ~SegmentRecorder();
+    SegmentRecorder(const SegmentRecorder&) = delete;
+    SegmentRecorder& operator=(const SegmentRecorder&) = delete;
+
+    bool write(const std::complex<int8_t>* samples, long long timeNs, int flags) override;
+    void close() override;
+
+    long long blocks() const override { return blocksWritten; }
+    long long bytes() const override { return closedBytes + (current ? current->bytes() : 0); }
+    bool failed() const override { return openFailed || closeFailed || (current && current->failed()); }
+    long long segments() const { return segmentCount; }
+
+private:
+    /*close the current segment (in the background) and open the one starting at `positionNs`*/
+    void roll();
+    /*blocks that fit into a segment starting at `positionNs`*/
+    long long segmentBlocks() const;
+    void finish(std::unique_ptr<IqWriter> writer, std::string fileName, long long reservedBytes);
+    void prune(long long reservedBytes);
+
+    std::string prefix;
+    IqHeader header;
+    SegmentSettings settings;
+    std::unique_ptr<IqWriter> current;
+    std::string currentName;
+    long long currentBlocks = 0;
+    long long blocksWritten = 0;
+    long long closedBytes = 0;
+    long long segmentCount = 0;
+    long long startNs = 0;
+    long long positionNs = 0;
+    long long nextBoundaryNs = 0;
+    bool openFailed = false;
+    std::atomic<bool> closeFailed{false};
+    std::thread closer;
+    /*segments on the disk, oldest first, with their sizes. Only touched by the closer*/
+    std::deque<std::pair<std::string, long long>> closed;
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef _RINGBUFFER_H
+#define _RINGBUFFER_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <stdexcept>
+
+/*
+single-producer/single-consumer lock-free ring of preallocated slots.
+The producer fills a slot in place and publishes it, the consumer
+reads it in place and releases it, nothing is copied or allocated
+after construction   */
+template<typename T>
+class SpscRing
+{
+public:
+    /*capacity is rounded up to a power of 2*/
+    SpscRing(size_t capacity, const T& prototype)
+    {
+        if(capacity == 0)
+        {
+            throw std::invalid_argument{"Ring capacity must be positive"};
+        }
+        size_t size = 1;
+        while(size < capacity)
+        {
+            size <<= 1;
+        }
+        slots.assign(size, prototype);
+        mask = size - 1;
+    }
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    /*producer side: free slot to fill or nullptr if the ring is full*/
+    T* acquire()
+    {
+        const size_t h = head.load(std::memory_order_relaxed);
+        if(h - tail.load(std::memory_order_acquire) == slots.size())
+        {
+            return nullptr;
+        }
+        return &slots[h & mask];
+    }
+    /*producer side: hand the slot from acquire() to the consumer, returns occupancy*/
+    size_t publish()
+    {
+        const size_t h = head.load(std::memory_order_relaxed) + 1;
+        head.store(h, std::memory_order_release);
+        return h - tail.load(std::memory_order_acquire);
+    }
+
+    /*consumer side: oldest published slot or nullptr if the ring is empty*/
+    T* front()
+    {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if(head.load(std::memory_order_acquire) == t)
+        {
+            return nullptr;
+        }
+        return &slots[t & mask];
+    }
+    /*consumer side: give the slot from front() back to the producer*/
+    void pop()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    size_t capacity() const { return slots.size(); }
+    size_t occupancy() const
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask = 0;
+    /*keep the indices on separate cache lines, producer and consumer run on different cores*/
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef _RXBLOCK_H
+#define _RXBLOCK_H
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+
+/*per-block flags saved next to the time stamp*/
+enum BlockFlags
+{
+    blockHasTime = 1 << 0,      //time_ns came from the device
+    blockAfterOverflow = 1 << 1,//device reported an overflow while filling this block
+    blockAfterDrop = 1 << 2     //blocks were dropped right before this one
+};
+
+/*one received block, the unit passed from the RX thread to the writer*/
+struct RxBlock
+{
+    std::vector<std::complex<int8_t>> samples;
+    long long timeNs = 0;
+    int flags = 0;
+};
+
+#endif
@@ -0,0 +1,371 @@
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <unistd.h>
+#include "settings.h"
+#include "spectrum.h"
+#include "recorder.h"
+
+static bool parseBool(const std::string& text)
+{
+    if(text == "1" || text == "true" || text == "yes" || text == "on")
+    {
+        return true;
+    }
+    if(text == "0" || text == "false" || text == "no" || text == "off")
+    {
+        return false;
+    }
+    throw std::invalid_argument{"\"" + text + "\" is not true or false"};
+}
+
+static std::string number(double value)
+{
+    std::ostringstream text;
+    text << std::setprecision(15) << value;
+    return text.str();
+}
+
+/*a key of radar.conf, the option that sets it for one run, and how its value is read and written*/
+struct Setting
+{
+    const char* key;
+    const char* option;
+    void (*set)(arguments&, const std::string&);
+    std::string (*get)(const arguments&);
+};
+
+static const Setting settings[] =
+{
+    {"sample_rate", "-s",
+     [](arguments& a, const std::string& v) { a.sampleRate = parseRange(v, 1, 1e10); },
+     [](const arguments& a) { return number(a.sampleRate); }},
+    {"freq", "-f",
+     [](arguments& a, const std::string& v) { a.freq = parseRange(v, 0, 1e12); },
+     [](const arguments& a) { return number(a.freq); }},
+    {"gain", "-g",
+     [](arguments& a, const std::string& v) { a.gain = parseInteger(v, -1000, 1000); },
+     [](const arguments& a) { return number(a.gain); }},
+    {"bandwidth", "-b",
+     [](arguments& a, const std::string& v) { a.bandwidth = parseInteger(v, 0, 2e9); },
+     [](const arguments& a) { return number(a.bandwidth); }},
+    {"block_lenght", "-l",
+     [](arguments& a, const std::string& v) { a.blockLenght = parseInteger(v, 16, 1 << 24); },
+     [](const arguments& a) { return number(a.blockLenght); }},
+    {"number_of_blocks", "-n",
+     [](arguments& a, const std::string& v) { a.numberOfBlocks = parseInteger(v, 1, 2e9); },
+     [](const arguments& a) { return number(a.numberOfBlocks); }},
+    {"ring_blocks", "-R",
+     [](arguments& a, const std::string& v) { a.ringBlocks = parseInteger(v, 1, 1 << 20); },
+     [](const arguments& a) { return number(a.ringBlocks); }},
+    {"window", "-W",
+     [](arguments& a, const std::string& v) { windowFromName(v); a.window = v; },
+     [](const arguments& a) { return a.window; }},
+    {"overlap", "-O",
+     [](arguments& a, const std::string& v)
+     {
+         const int overlap = parseInteger(v, 0, 75);
+         if(overlap != 0 && overlap != 50 && overlap != 75)
+         {
+             throw std::invalid_argument{"overlap must be 0, 50 or 75"};
+         }
+         a.overlap = overlap;
+     },
+     [](const arguments& a) { return number(a.overlap); }},
+    {"remove_dc", "-D",
+     [](arguments& a, const std::string& v) { a.removeDc = parseBool(v); },
+     [](const arguments& a) { return std::string{a.removeDc ? "true" : "false"}; }},
+    {"planner", "-P",
+     [](arguments& a, const std::string& v) { plannerFlags(v); a.planner = v; },
+     [](const arguments& a) { return a.planner; }},
+    {"compress", "-Z",
+     [](arguments& a, const std::string& v) { a.compress = parseBool(v); },
+     [](const arguments& a) { return std::string{a.compress ? "true" : "false"}; }},
+    {"segment", "-r",
+     [](arguments& a, const std::string& v)
+     {
+         SegmentSettings segment;
+         if(v != "0")
+         {
+             parseSegmentLimit(v, segment);
+         }
+         a.segmentSeconds = segment.seconds;
+         a.segmentBytes = segment.bytes;
+     },
+     [](const arguments& a) { return a.segmentBytes > 0 ? formatBytes(a.segmentBytes) : number(a.segmentSeconds); }},
+    {"disk_budget", "-Q",
+     [](arguments& a, const std::string& v) { a.diskBudget = v == "0" ? 0 : parseBytes(v); },
+     [](const arguments& a) { return a.diskBudget > 0 ? formatBytes(a.diskBudget) : std::string{"0"}; }},
+    {"drop_cache", "-N",
+     [](arguments& a, const std::string& v) { a.dropCache = parseBool(v); },
+     [](const arguments& a) { return std::string{a.dropCache ? "true" : "false"}; }},
+};
+
+static const Setting* findSetting(const std::string& key)
+{
+    for(const Setting& setting : settings)
+    {
+        if(key == setting.key)
+        {
+            return &setting;
+        }
+    }
+    return nullptr;
+}
+
+bool isProfileNameValid(const std::string& name)
+{
+    if(name.empty())
+    {
+        return false;
+    }
+    for(char c : name)
+    {
+        if(!std::isalnum(static_cast<unsigned char>(c)) && c != '.' && c != '-' && c != '_')
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string trim(const std::string& text)
+{
+    const size_t first = text.find_first_not_of(" \t\r");
+    if(first == std::string::npos)
+    {
+        return "";
+    }
+    return text.substr(first, text.find_last_not_of(" \t\r") - first + 1);
+}
+
+std::vector<Profile> readProfiles(const std::string& fileName)
+{
+    std::vector<Profile> profiles;
+    std::ifstream file(fileName);
+    if(!file.is_open())
+    {
+        return profiles;
+    }
+    std::string line;
+    for(int number = 1; std::getline(file, line); number++)
+    {
+        const std::string where = fileName + ":" + std::to_string(number) + ": ";
+        line = trim(line.substr(0, line.find('#')));
+        if(line.empty())
+        {
+            continue;
+        }
+        if(line.front() == '[')
+        {
+            const std::string name = line.back() == ']' ? trim(line.substr(1, line.size() - 2)) : "";
+            if(!isProfileNameValid(name))
+            {
+                throw std::runtime_error{where + "\"" + line + "\" is not a valid [profile]"};
+            }
+            for(const Profile& profile : profiles)
+            {
+                if(profile.name == name)
+                {
+                    throw std::runtime_error{where + "profile " + name + " is given twice"};
+                }
+            }
+            profiles.push_back({name, {}});
+            continue;
+        }
+        const size_t equals = line.find('=');
+        if(equals == std::string::npos)
+        {
+            throw std::runtime_error{where + "expected key = value, not \"" + line + "\""};
+        }
+        const std::string key = trim(line.substr(0, equals));
+        const std::string value = trim(line.substr(equals + 1));
+        if(findSetting(key) == nullptr)
+        {
+            throw std::runtime_error{where + "unknown setting " + key};
+        }
+        if(profiles.empty())
+        {
+            throw std::runtime_error{where + key + " is outside of any [profile]"};
+        }
+        /*checked here, so a bad value is found in any profile and not only in the one that is used*/
+        arguments scratch;
+        try
+        {
+            applySetting(scratch, key, value);
+        }
+        catch(const std::invalid_argument& e)
+        {
+            throw std::runtime_error{where + key + ": " + e.what()};
+        }
+        profiles.back().values.emplace_back(key, value);
+    }
+    return profiles;
+}
+
+/*settings.conf of older versions: sample rate, frequency, gain, bandwidth, block lenght, number of blocks*/
+static std::vector<Profile> readLegacySettings()
+{
+    std::vector<Profile> profiles;
+    std::ifstream file(legacySettingsFileName);
+    if(!file.is_open())
+    {
+        return profiles;
+    }
+    const char* keys[] = {"sample_rate", "freq", "gain", "bandwidth", "block_lenght", "number_of_blocks"};
+    Profile profile{defaultProfile, {}};
+    std::string line;
+    for(int number = 0; number < 6 && std::getline(file, line); number++)
+    {
+        line = trim(line);
+        arguments scratch;
+        try
+        {
+            applySetting(scratch, keys[number], line);
+        }
+        catch(const std::invalid_argument& e)
+        {
+            throw std::runtime_error{legacySettingsFileName + ":" + std::to_string(number + 1) + ": " + e.what()};
+        }
+        profile.values.emplace_back(keys[number], line);
+    }
+    profiles.push_back(profile);
+    return profiles;
+}
+
+void applySetting(arguments& arguments, const std::string& key, const std::string& value)
+{
+    const Setting* setting = findSetting(key);
+    if(setting == nullptr)
+    {
+        throw std::invalid_argument{"unknown setting " + key};
+    }
+    setting->set(arguments, value);
+}
+
+static const Profile* findProfile(const std::vector<Profile>& profiles, const std::string& name)
+{
+    for(const Profile& profile : profiles)
+    {
+        if(profile.name == name)
+        {
+            return &profile;
+        }
+    }
+    return nullptr;
+}
+
+void loadSettings(arguments& arguments)
+{
+    std::vector<Profile> profiles = readProfiles(settingsFileName);
+    std::string source = settingsFileName;
+    if(profiles.empty() && access(settingsFileName.c_str(), F_OK) != 0)
+    {
+        profiles = readLegacySettings();
+        source = legacySettingsFileName;
+    }
+    if(const Profile* base = findProfile(profiles, defaultProfile))
+    {
+        for(const auto& value : base->values)
+        {
+            applySetting(arguments, value.first, value.second);
+        }
+    }
+    if(arguments.profile != defaultProfile)
+    {
+        const Profile* profile = findProfile(profiles, arguments.profile);
+        /*-U creates the profile, anything else needs it to exist*/
+        if(profile == nullptr && !arguments.saveProfile)
+        {
+            throw std::runtime_error{"There is no profile " + arguments.profile + " in " + source};
+        }
+        if(profile != nullptr)
+        {
+            for(const auto& value : profile->values)
+            {
+                applySetting(arguments, value.first, value.second);
+            }
+        }
+    }
+    for(const auto& value : arguments.overrides)
+    {
+        try
+        {
+            applySetting(arguments, value.first, value.second);
+        }
+        catch(const std::invalid_argument& e)
+        {
+            throw std::runtime_error{std::string{findSetting(value.first)->option} + ": " + e.what()};
+        }
+    }
+}
+
+void saveSettings(const arguments& arguments)
+{
+    std::vector<Profile> profiles = readProfiles(settingsFileName);
+    if(profiles.empty())
+    {
+        profiles = readLegacySettings();
+    }
+    Profile current{arguments.profile, {}};
+    for(const Setting& setting : settings)
+    {
+        current.values.emplace_back(setting.key, setting.get(arguments));
+    }
+    bool replaced = false;
+    for(Profile& profile : profiles)
+    {
+        if(profile.name == current.name)
+        {
+            profile = current;
+            replaced = true;
+        }
+    }
+    if(!replaced)
+    {
+        profiles.push_back(current);
+    }
+
+    /*written next to it and renamed, radar.conf is never half written*/
+    const std::string temporary = settingsFileName + ".tmp" + std::to_string(getpid());
+    std::ofstream file(temporary, std::ios::trunc);
+    file << "# radar settings: [default] applies to every run, radar -C NAME runs with the profile NAME over it\n";
+    for(const Profile& profile : profiles)
+    {
+        file << "\n[" << profile.name << "]\n";
+        for(const auto& value : profile.values)
+        {
+            file << value.first << " = " << value.second << "\n";
+        }
+    }
+    file.close();
+    if(!file || std::rename(temporary.c_str(), settingsFileName.c_str()) != 0)
+    {
+        std::remove(temporary.c_str());
+        throw std::runtime_error{"Saving to " + settingsFileName + " failed >_<"};
+    }
+    std::cout << "Profile " << arguments.profile << " saved to " << settingsFileName << std::endl;
+}
+
+void showSettings(const arguments& arguments, std::ostream& out)
+{
+    out << "Profile " << arguments.profile << ":" << std::endl;
+    for(const Setting& setting : settings)
+    {
+        out << "  " << std::left << std::setw(18) << setting.key << std::right << setting.get(arguments)
+            << "  (" << setting.option << ")" << std::endl;
+    }
+    const std::vector<Profile> profiles = readProfiles(settingsFileName);
+    if(!profiles.empty())
+    {
+        out << "Profiles in " << settingsFileName << ":";
+        for(const Profile& profile : profiles)
+        {
+            out << " " << profile.name;
+        }
+        out << std::endl;
+    }
+}
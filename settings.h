@@ -0,0 +1,48 @@
+#ifndef _SETTINGS_H
+#define _SETTINGS_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <ostream>
+#include "functions.h"
+#include "parse.h"
+
+/*
+profiles of settings, [NAME] sections of `key = value` lines, # starts a comment.
+[default] applies to every run, the profile picked with -C goes over it and
+options given on the command line over both. Nothing is written at startup */
+const std::string settingsFileName = "radar.conf";
+/*six unlabeled lines of older versions, read when there is no radar.conf yet*/
+const std::string legacySettingsFileName = "settings.conf";
+const std::string defaultProfile = "default";
+
+/*one [NAME] section of radar.conf, values in the order they were given*/
+struct Profile
+{
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> values;
+};
+
+/*letters, digits, '.', '-' and '_', so "meteor-105.5MHz-2.4Msps" is fine*/
+bool isProfileNameValid(const std::string& name);
+
+/*sections of `fileName`, throws with the line of the first error. Empty when the file does not exist*/
+std::vector<Profile> readProfiles(const std::string& fileName);
+
+/*parse and check one value, throws std::invalid_argument saying what is wrong with it*/
+void applySetting(arguments& arguments, const std::string& key, const std::string& value);
+
+/*
+compiled-in defaults, then [default] and the -C profile, then the options of
+the command line (arguments.overrides). Throws on the first invalid value
+instead of running with a setting nobody asked for */
+void loadSettings(arguments& arguments);
+
+/*-U: every setting of this run into the -C profile, radar.conf is replaced at once*/
+void saveSettings(const arguments& arguments);
+
+/*-S*/
+void showSettings(const arguments& arguments, std::ostream& out);
+
+#endif
@@ -0,0 +1,163 @@
+#include <cmath>
+#include <thread>
+#include <algorithm>
+#include <stdexcept>
+#include "source.h"
+
+/*a release() call for every this many replayed blocks, not one per block*/
+constexpr long long releaseEvery = 256;
+
+Pacer::Pacer(double sampleRate, double speed)
+    : samplesPerSecond(speed > 0 ? sampleRate * speed : 0)
+{
+}
+
+void Pacer::wait(long long samples)
+{
+    if(samplesPerSecond <= 0)
+    {
+        return;
+    }
+    const std::chrono::duration<double> due(samples / samplesPerSecond);
+    if(!started)
+    {
+        /*the first block is taken as just received, the rest follow at the rate*/
+        start = std::chrono::steady_clock::now() - std::chrono::duration_cast<std::chrono::steady_clock::duration>(due);
+        started = true;
+        return;
+    }
+    std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(due));
+}
+
+FileSource::FileSource(const std::string& fileName, double speed, bool loop)
+    : file(fileName), pacer(file.header().sampleRate, speed), loop(loop),
+      fileLenght(file.header().blockLenght),
+      captureNs(std::llround(file.blocks() * fileLenght * 1e9 / file.header().sampleRate))
+{
+    if(file.header().format != IqFormat::cs8)
+    {
+        throw std::runtime_error{fileName + " holds " + iqFormatName(file.header().format) + " samples, only cs8 can be replayed"};
+    }
+    if(file.blocks() == 0)
+    {
+        throw std::runtime_error{fileName + " has no whole block to replay"};
+    }
+    current.resize(fileLenght);
+    used = fileLenght;
+}
+
+bool FileSource::load()
+{
+    if(fileBlock == file.blocks())
+    {
+        if(!loop)
+        {
+            return false;
+        }
+        file.release(fileBlock - fileBlock % releaseEvery, fileBlock % releaseEvery);
+        fileBlock = 0;
+        loops++;
+    }
+    if(!file.decode(fileBlock, current.data()))
+    {
+        throw std::runtime_error{"Block " + std::to_string(fileBlock) + " of the replayed file is damaged"};
+    }
+    long long timeNs = 0;
+    if(file.blockTime(fileBlock, timeNs, currentFlags))
+    {
+        currentTimeNs = timeNs + loops * captureNs;
+    }
+    fileBlock++;
+    if(fileBlock % releaseEvery == 0)
+    {
+        file.release(fileBlock - releaseEvery, releaseEvery);
+    }
+    used = 0;
+    return true;
+}
+
+bool FileSource::read(RxBlock& block, AcquisitionStats& stats)
+{
+    const size_t lenght = block.samples.size();
+    size_t filled = 0;
+    block.timeNs = 0;
+    block.flags = 0;
+    while(filled < lenght)
+    {
+        if(used == current.size())
+        {
+            if(!load())
+            {
+                return false;
+            }
+            /*overflows and drops of the capture stay with the block they were found in*/
+            block.flags |= currentFlags & ~blockHasTime;
+        }
+        if(filled == 0 && (currentFlags & blockHasTime))
+        {
+            block.timeNs = currentTimeNs + std::llround(used * 1e9 / sampleRate());
+            block.flags |= blockHasTime;
+        }
+        const size_t take = std::min(lenght - filled, current.size() - used);
+        std::copy(current.begin() + used, current.begin() + used + take, block.samples.begin() + filled);
+        used += take;
+        filled += take;
+    }
+    position += lenght;
+    stats.samplesReceived += lenght;
+    pacer.wait(position);
+    return true;
+}
+
+SyntheticSource::SyntheticSource(double freq, const SyntheticSettings& settings, double speed)
+    : signal(settings), pacer(settings.sampleRate, speed), centerFreq(freq), rate(settings.sampleRate),
+      startNs(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count())
+{
+}
+
+bool SyntheticSource::read(RxBlock& block, AcquisitionStats& stats)
+{
+    block.timeNs = startNs + std::llround(signal.position() * 1e9 / rate);
+    block.flags = blockHasTime;
+    signal.generate(block.samples.data(), block.samples.size());
+    stats.samplesReceived += block.samples.size();
+    pacer.wait(signal.position());
+    return true;
+}
+
+AlignedSource::AlignedSource(std::unique_ptr<SampleSource> source, long long startNs)
+    : source(std::move(source)), startNs(startNs)
+{
+}
+
+bool AlignedSource::read(RxBlock& block, AcquisitionStats& stats)
+{
+    if(!started)
+    {
+        std::this_thread::sleep_until(std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(startNs))));
+        source->flush();
+        started = true;
+    }
+    if(!source->read(block, stats))
+    {
+        return false;
+    }
+    const long long countedNs = std::llround(samples * 1e9 / sampleRate());
+    if(block.flags & blockHasTime)
+    {
+        if(!haveFirst)
+        {
+            firstNs = block.timeNs - countedNs;
+            haveFirst = true;
+        }
+        block.timeNs = startNs + (block.timeNs - firstNs);
+    }
+    else
+    {
+        block.timeNs = startNs + countedNs;
+        block.flags |= blockHasTime;
+    }
+    samples += block.samples.size();
+    return true;
+}
@@ -0,0 +1,114 @@
+#ifndef _SOURCE_H
+#define _SOURCE_H
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include "acquisition.h"
+#include "iqfile.h"
+#include "synthetic.h"
+
+/*
+holds a source back to `speed` times real time: 1 delivers samples as a receiver
+would, 10 ten times faster, 0 (or less) as fast as the consumer takes them */
+class Pacer
+{
+public:
+    Pacer(double sampleRate, double speed);
+
+    /*wait until `samples` samples from the start are due*/
+    void wait(long long samples);
+
+private:
+    double samplesPerSecond;
+    bool started = false;
+    std::chrono::steady_clock::time_point start;
+};
+
+/*
+replays a CS8 .iq file, coded or not, as if it was being received. Blocks of any
+lenght are cut from the blocks of the file, their time stamps and flags come
+from the block index. With `loop` the file starts again when it ends and its
+time stamps are moved on by the lenght of the capture, so they keep going
+forward; otherwise the source ends at the last whole block */
+class FileSource : public SampleSource
+{
+public:
+    FileSource(const std::string& fileName, double speed, bool loop);
+
+    bool read(RxBlock& block, AcquisitionStats& stats) override;
+    double freq() const override { return file.header().freq; }
+    double sampleRate() const override { return file.header().sampleRate; }
+
+private:
+    /*make block `fileBlock` of the file the current one, false at the end*/
+    bool load();
+
+    IqFile file;
+    Pacer pacer;
+    bool loop;
+    size_t fileLenght;
+    long long captureNs;
+    long long fileBlock = 0;
+    long long loops = 0;
+    /*counts of the current file block, and how many of them were handed out*/
+    std::vector<std::complex<int8_t>> current;
+    size_t used = 0;
+    long long currentTimeNs = 0;
+    int currentFlags = 0;
+    long long position = 0;
+};
+
+/*
+SyntheticSignal as a receiver: tones, noise and meteor echoes with time stamps
+from the host clock at the start plus the samples generated so far */
+class SyntheticSource : public SampleSource
+{
+public:
+    SyntheticSource(double freq, const SyntheticSettings& settings, double speed);
+
+    bool read(RxBlock& block, AcquisitionStats& stats) override;
+    double freq() const override { return centerFreq; }
+    double sampleRate() const override { return rate; }
+    /*only the reported center moves, the signal stays the same*/
+    void tune(double freq) override { centerFreq = freq; }
+
+private:
+    SyntheticSignal signal;
+    Pacer pacer;
+    double centerFreq;
+    double rate;
+    long long startNs;
+};
+
+/*
+starts `source` at the host time `startNs`: the first read waits for it and drops
+what the receiver queued before, time stamps are moved to count from startNs.
+Receivers started together this way share one time base, their captures line
+up within the jitter of restarting the streams. Blocks the receiver gives no
+time get one counted from the samples read since the start */
+class AlignedSource : public SampleSource
+{
+public:
+    AlignedSource(std::unique_ptr<SampleSource> source, long long startNs);
+
+    bool read(RxBlock& block, AcquisitionStats& stats) override;
+    double freq() const override { return source->freq(); }
+    double sampleRate() const override { return source->sampleRate(); }
+    void tune(double freq) override { source->tune(freq); }
+    void flush() override { source->flush(); }
+
+private:
+    std::unique_ptr<SampleSource> source;
+    long long startNs;
+    bool started = false;
+    bool haveFirst = false;
+    /*device time of the first sample after the start*/
+    long long firstNs = 0;
+    long long samples = 0;
+};
+
+#endif
@@ -0,0 +1,468 @@
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include "spectrum.h"
+#include "kernels.h"
+#include "metrics.h"
+
+unsigned plannerFlags(const std::string& planner)
+{
+    if(planner == "estimate")
+    {
+        return FFTW_ESTIMATE;
+    }
+    if(planner == "measure")
+    {
+        return FFTW_MEASURE;
+    }
+    if(planner == "patient")
+    {
+        return FFTW_PATIENT;
+    }
+    if(planner == "exhaustive")
+    {
+        return FFTW_EXHAUSTIVE;
+    }
+    throw std::invalid_argument{"Unknown FFTW planner: " + planner};
+}
+
+SpectrumEngine::SpectrumEngine(unsigned flags, const std::string& wisdomFile)
+    : flags(flags), wisdomFile(wisdomFile)
+{
+    /*missing wisdom file is fine, it will be created on exit*/
+    if(!wisdomFile.empty())
+    {
+        fftwf_import_wisdom_from_filename(wisdomFile.c_str());
+    }
+}
+
+SpectrumEngine::~SpectrumEngine()
+{
+    for(auto& p : plans)
+    {
+        fftwf_destroy_plan(p.second);
+    }
+    for(auto& b : buffersBySize)
+    {
+        fftwf_free(b.second.in);
+        fftwf_free(b.second.out);
+    }
+    if(wisdomChanged && !wisdomFile.empty())
+    {
+        fftwf_export_wisdom_to_filename(wisdomFile.c_str());
+    }
+}
+
+SpectrumEngine::Buffers& SpectrumEngine::buffers(int lenght, int howmany)
+{
+    if(lenght <= 0 || howmany <= 0)
+    {
+        throw std::invalid_argument{"FFT lenght and batch size must be positive"};
+    }
+    auto key = std::make_pair(lenght, howmany);
+    auto itr = buffersBySize.find(key);
+    if(itr == buffersBySize.end())
+    {
+        size_t bytes = static_cast<size_t>(lenght) * howmany * sizeof(fftwf_complex);
+        Buffers b;
+        b.in = reinterpret_cast<fftwf_complex*>(fftwf_malloc(bytes));
+        b.out = reinterpret_cast<fftwf_complex*>(fftwf_malloc(bytes));
+        if(b.in == nullptr || b.out == nullptr)
+        {
+            fftwf_free(b.in);
+            fftwf_free(b.out);
+            throw std::runtime_error{"Cannot allocate FFT buffers"};
+        }
+        itr = buffersBySize.emplace(key, b).first;
+    }
+    return itr->second;
+}
+
+fftwf_complex* SpectrumEngine::input(int lenght, int howmany)
+{
+    return buffers(lenght, howmany).in;
+}
+
+fftwf_complex* SpectrumEngine::output(int lenght, int howmany)
+{
+    return buffers(lenght, howmany).out;
+}
+
+fftwf_plan SpectrumEngine::plan(int lenght, int howmany, int direction)
+{
+    auto key = std::make_tuple(lenght, howmany, direction);
+    auto itr = plans.find(key);
+    if(itr != plans.end())
+    {
+        return itr->second;
+    }
+
+    /*
+    FFTW_MEASURE and above overwrite the arrays while planning,
+    so plan on scratch arrays and run it later with new-array execute.
+    fftwf_malloc gives the same alignment, so the plan stays valid   */
+    size_t bytes = static_cast<size_t>(lenght) * howmany * sizeof(fftwf_complex);
+    fftwf_complex* scratchIn = reinterpret_cast<fftwf_complex*>(fftwf_malloc(bytes));
+    fftwf_complex* scratchOut = reinterpret_cast<fftwf_complex*>(fftwf_malloc(bytes));
+
+    /*blocks are contiguous: unit stride inside a block, `lenght` between blocks*/
+    fftwf_plan p = fftwf_plan_many_dft(1, &lenght, howmany,
+                                     scratchIn, nullptr, 1, lenght,
+                                     scratchOut, nullptr, 1, lenght,
+                                     direction, flags);
+    fftwf_free(scratchIn);
+    fftwf_free(scratchOut);
+    if(p == nullptr)
+    {
+        throw std::runtime_error{"Cannot create FFT plan"};
+    }
+    plans.emplace(key, p);
+    wisdomChanged = true;
+    return p;
+}
+
+void SpectrumEngine::prepare(int lenght, int howmany, int direction)
+{
+    buffers(lenght, howmany);
+    plan(lenght, howmany, direction);
+}
+
+void SpectrumEngine::execute(int lenght, int howmany, int direction)
+{
+    METRICS_TIME(Stage::fft);
+    Buffers& b = buffers(lenght, howmany);
+    fftwf_execute_dft(plan(lenght, howmany, direction), b.in, b.out);
+}
+
+void SpectrumEngine::load(const std::complex<int8_t>* samples, int lenght, int howmany, int hop,
+                          const float* windowIQ, bool removeDc)
+{
+    METRICS_TIME(Stage::convert);
+    float* in = reinterpret_cast<float*>(buffers(lenght, howmany).in);
+    for(int b = 0; b < howmany; b++)
+    {
+        const std::complex<int8_t>* segment = samples + static_cast<size_t>(b) * hop;
+        float* out = in + 2 * static_cast<size_t>(b) * lenght;
+        float dcI = 0;
+        float dcQ = 0;
+        if(removeDc)
+        {
+            dcOffset(segment, lenght, dcI, dcQ);
+        }
+        convertCs8(segment, out, lenght, dcI, dcQ);
+        if(windowIQ != nullptr)
+        {
+            applyWindow(out, windowIQ, 2 * static_cast<size_t>(lenght));
+        }
+    }
+}
+
+void SpectrumEngine::accumulatePower(float* sum, int lenght, int howmany)
+{
+    METRICS_TIME(Stage::accumulate);
+    const float* out = reinterpret_cast<const float*>(buffers(lenght, howmany).out);
+    for(int b = 0; b < howmany; b++)
+    {
+        ::accumulatePower(out + 2 * static_cast<size_t>(b) * lenght, sum, lenght);
+    }
+}
+
+WindowType windowFromName(const std::string& name)
+{
+    if(name == "rect" || name == "rectangular")
+    {
+        return WindowType::rectangular;
+    }
+    if(name == "hann")
+    {
+        return WindowType::hann;
+    }
+    if(name == "blackman-harris")
+    {
+        return WindowType::blackmanHarris;
+    }
+    if(name == "flattop")
+    {
+        return WindowType::flatTop;
+    }
+    throw std::invalid_argument{"Unknown window: " + name};
+}
+
+std::vector<float> makeWindow(WindowType type, int lenght)
+{
+    /*periodic windows, the right choice for spectral analysis*/
+    std::vector<double> a;
+    switch(type)
+    {
+    case WindowType::rectangular:
+        a = {1.0};
+        break;
+    case WindowType::hann:
+        a = {0.5, 0.5};
+        break;
+    case WindowType::blackmanHarris:
+        a = {0.35875, 0.48829, 0.14128, 0.01168};
+        break;
+    case WindowType::flatTop:
+        a = {0.21557895, 0.41663158, 0.277263158, 0.083578947, 0.006947368};
+        break;
+    }
+    std::vector<float> w(lenght);
+    for(int n = 0; n < lenght; n++)
+    {
+        double value = 0;
+        for(size_t k = 0; k < a.size(); k++)
+        {
+            value += ((k % 2) ? -a[k] : a[k]) * cos(2 * M_PI * k * n / lenght);
+        }
+        w[n] = static_cast<float>(value);
+    }
+    return w;
+}
+
+SpectrumAverager::SpectrumAverager(const WelchSettings& settings)
+    : N(settings.lenght),
+      batchSegments(std::max(1, settings.batchSegments)),
+      removeDc(settings.removeDc),
+      sum(settings.lenght, 0.0),
+      openPartial(settings.lenght, 0.0f)
+{
+    if(N <= 0)
+    {
+        throw std::invalid_argument{"FFT lenght must be positive"};
+    }
+    if(settings.overlapPercent < 0 || settings.overlapPercent >= 100)
+    {
+        throw std::invalid_argument{"Overlap must be between 0 and 99 %"};
+    }
+    hopSize = std::max(1, N * (100 - settings.overlapPercent) / 100);
+
+    std::vector<float> window = makeWindow(settings.window, N);
+    windowIQ.resize(2 * static_cast<size_t>(N));
+    for(int n = 0; n < N; n++)
+    {
+        windowIQ[2 * n] = window[n];
+        windowIQ[2 * n + 1] = window[n];
+        windowSum += window[n];
+        windowPowerSum += static_cast<double>(window[n]) * window[n];
+    }
+
+    int threads = settings.threads;
+    if(threads <= 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    /*
+    only the first engine saves wisdom. The others are planned after it,
+    so FFTW hands them the same algorithm from wisdom.
+    Planning is not thread safe, so every plan is made here    */
+    for(int i = 0; i < threads; i++)
+    {
+        engines.emplace_back(new SpectrumEngine(settings.flags, i == 0 ? wisdomFileName : std::string{}));
+        engines.back()->prepare(N, batchSegments);
+        engines.back()->prepare(N, 1);
+    }
+}
+
+void SpectrumAverager::reset()
+{
+    std::fill(sum.begin(), sum.end(), 0.0);
+    std::fill(openPartial.begin(), openPartial.end(), 0.0f);
+    segmentCount = 0;
+    carry.clear();
+}
+
+void SpectrumAverager::process(const std::complex<int8_t>* samples, size_t count)
+{
+    if(count == 0)
+    {
+        return;
+    }
+
+    /*segments starting in the carried tail are cut from the tail plus the head of this span*/
+    size_t offset = 0;
+    if(!carry.empty())
+    {
+        const size_t head = std::min(count, static_cast<size_t>(N));
+        stitched.assign(carry.begin(), carry.end());
+        stitched.insert(stitched.end(), samples, samples + head);
+
+        long long inStitched = 0;
+        size_t start = 0;
+        while(start < carry.size() && start + N <= stitched.size())
+        {
+            inStitched++;
+            start += hopSize;
+        }
+        runSegments(stitched.data(), inStitched);
+
+        if(start < carry.size())
+        {
+            /*this span was too short to finish them, keep waiting*/
+            carry.assign(stitched.begin() + start, stitched.end());
+            return;
+        }
+        offset = start - carry.size();
+    }
+
+    /*the rest is read in place*/
+    long long direct = 0;
+    if(offset <= count && count - offset >= static_cast<size_t>(N))
+    {
+        direct = (count - offset - N) / hopSize + 1;
+    }
+    runSegments(samples + offset, direct);
+
+    const size_t next = std::min(count, offset + static_cast<size_t>(direct) * hopSize);
+    carry.assign(samples + next, samples + count);
+}
+
+void SpectrumAverager::runSegments(const std::complex<int8_t>* base, long long count)
+{
+    if(count <= 0)
+    {
+        return;
+    }
+
+    /*
+    batches start at multiples of batchSegments counted from the start of the stream.
+    The first batch continues the open one, the last one may stay open  */
+    struct Item
+    {
+        long long first;    //segment index inside this run
+        int count;
+        float* target;
+    };
+    const long long firstGlobal = segmentCount;
+    const long long lastGlobal = segmentCount + count;
+    std::vector<Item> items;
+    size_t used = 0;
+    for(long long g = firstGlobal; g < lastGlobal; )
+    {
+        long long batchEnd = (g / batchSegments + 1) * batchSegments;
+        long long end = std::min(batchEnd, lastGlobal);
+        float* target;
+        if(g == firstGlobal)
+        {
+            target = openPartial.data();
+        }
+        else
+        {
+            if(used == partials.size())
+            {
+                partials.emplace_back(N);
+            }
+            std::fill(partials[used].begin(), partials[used].end(), 0.0f);
+            target = partials[used++].data();
+        }
+        items.push_back({g - firstGlobal, static_cast<int>(end - g), target});
+        g = end;
+    }
+
+    std::atomic<size_t> next{0};
+    auto worker = [&](SpectrumEngine& engine)
+    {
+        for(size_t i = next++; i < items.size(); i = next++)
+        {
+            const Item& item = items[i];
+            const std::complex<int8_t>* first = base + item.first * hopSize;
+            if(item.count == batchSegments)
+            {
+                engine.load(first, N, batchSegments, hopSize, windowIQ.data(), removeDc);
+                engine.execute(N, batchSegments, FFTW_FORWARD);
+                engine.accumulatePower(item.target, N, batchSegments);
+                continue;
+            }
+            /*pieces of a batch go one segment at a time, so only two plans are ever needed*/
+            for(int s = 0; s < item.count; s++)
+            {
+                engine.load(first + static_cast<size_t>(s) * hopSize, N, 1, hopSize, windowIQ.data(), removeDc);
+                engine.execute(N, 1, FFTW_FORWARD);
+                engine.accumulatePower(item.target, N, 1);
+            }
+        }
+    };
+
+    const size_t workers = std::min(engines.size(), items.size());
+    if(workers == 1)
+    {
+        worker(*engines[0]);
+    }
+    else
+    {
+        std::vector<std::thread> pool;
+        for(size_t i = 0; i < workers; i++)
+        {
+            pool.emplace_back(worker, std::ref(*engines[i]));
+        }
+        for(auto& t : pool)
+        {
+            t.join();
+        }
+    }
+
+    /*deterministic reduction: completed batches are added in batch order*/
+    segmentCount = lastGlobal;
+    for(size_t i = 0; i < items.size(); i++)
+    {
+        const long long batchStart = (firstGlobal + items[i].first) / batchSegments * batchSegments;
+        const bool complete = firstGlobal + items[i].first + items[i].count == batchStart + batchSegments;
+        if(!complete)
+        {
+            /*only the last item can be incomplete, it becomes the open batch*/
+            if(items[i].target != openPartial.data())
+            {
+                std::copy(items[i].target, items[i].target + N, openPartial.begin());
+            }
+            break;
+        }
+        for(int k = 0; k < N; k++)
+        {
+            sum[k] += items[i].target[k];
+        }
+        if(items[i].target == openPartial.data())
+        {
+            std::fill(openPartial.begin(), openPartial.end(), 0.0f);
+        }
+    }
+}
+
+std::vector<double> SpectrumAverager::powerSum() const
+{
+    /*the open batch counts as if the stream ended here*/
+    std::vector<double> total(sum);
+    if(segmentCount % batchSegments != 0)
+    {
+        for(int k = 0; k < N; k++)
+        {
+            total[k] += openPartial[k];
+        }
+    }
+    return total;
+}
+
+Psd SpectrumAverager::psd(double centerFreq, double sampleRate) const
+{
+    /*full scale of int8 counts*/
+    const double fullScale = 128.0;
+    const std::vector<double> power = powerSum();
+    const double scale = 1.0 / (std::max<long long>(1, segmentCount) * sampleRate * windowPowerSum * fullScale * fullScale);
+
+    Psd result;
+    result.enbwHz = sampleRate * windowPowerSum / (windowSum * windowSum);
+    result.freqMHz.resize(N);
+    result.dbfsPerHz.resize(N);
+
+    /*fftshift: bin N/2 (the most negative frequency) goes first*/
+    const int half = N / 2;
+    for(int k = 0; k < N; k++)
+    {
+        const int bin = (k + N - half) % N;
+        result.freqMHz[k] = (centerFreq + static_cast<double>(k - half) * sampleRate / N) / 1e6;
+        result.dbfsPerHz[k] = 10 * log10(std::max(power[bin] * scale, 1e-30));
+    }
+    return result;
+}
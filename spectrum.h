@@ -0,0 +1,154 @@
+#ifndef _SPECTRUM_H
+#define _SPECTRUM_H
+
+#include <map>
+#include <tuple>
+#include <memory>
+#include <string>
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <fftw3.h>
+
+/*FFTW keeps measured single precision plans here so planning is paid once per machine*/
+const std::string wisdomFileName = "fftwf.wisdom";
+
+/*translate -P argument (estimate, measure, patient, exhaustive) to FFTW flags*/
+unsigned plannerFlags(const std::string& planner);
+
+/*
+owns aligned FFT buffers and one plan per (block lenght, batch, direction)
+for its whole lifetime. Wisdom is loaded on construction and saved
+on destruction if new plans were measured.
+A batch is `howmany` blocks laid out back to back, transformed
+by a single fftwf_plan_many_dft. Everything runs in single precision,
+which is plenty for 8-bit counts   */
+class SpectrumEngine
+{
+public:
+    explicit SpectrumEngine(unsigned flags = FFTW_MEASURE, const std::string& wisdomFile = wisdomFileName);
+    ~SpectrumEngine();
+    SpectrumEngine(const SpectrumEngine&) = delete;
+    SpectrumEngine& operator=(const SpectrumEngine&) = delete;
+
+    /*buffers are allocated on first use and reused for every block*/
+    fftwf_complex* input(int lenght, int howmany = 1);
+    fftwf_complex* output(int lenght, int howmany = 1);
+    void execute(int lenght, int howmany = 1, int direction = FFTW_FORWARD);
+    /*create the plan now, FFTW planner must not be called from several threads at once*/
+    void prepare(int lenght, int howmany = 1, int direction = FFTW_FORWARD);
+
+    /*
+    convert `howmany` segments of iq counts, starting every `hop` samples,
+    straight into the input buffer. With removeDc the mean of every segment
+    is subtracted first, windowIQ (2 * lenght values) is applied if given */
+    void load(const std::complex<int8_t>* samples, int lenght, int howmany, int hop,
+              const float* windowIQ = nullptr, bool removeDc = false);
+    /*add |X|^2 of every output block to sum[0..lenght) in one pass*/
+    void accumulatePower(float* sum, int lenght, int howmany = 1);
+
+private:
+    struct Buffers
+    {
+        fftwf_complex* in;
+        fftwf_complex* out;
+    };
+    Buffers& buffers(int lenght, int howmany);
+    fftwf_plan plan(int lenght, int howmany, int direction);
+
+    unsigned flags;
+    std::string wisdomFile;
+    bool wisdomChanged = false;
+    std::map<std::pair<int, int>, Buffers> buffersBySize;
+    std::map<std::tuple<int, int, int>, fftwf_plan> plans;
+};
+
+/*window tables for the Welch estimator*/
+enum class WindowType
+{
+    rectangular,
+    hann,
+    blackmanHarris,
+    flatTop
+};
+/*translate -W argument (rect, hann, blackman-harris, flattop)*/
+WindowType windowFromName(const std::string& name);
+std::vector<float> makeWindow(WindowType type, int lenght);
+
+/*everything the Welch estimator needs to know*/
+struct WelchSettings
+{
+    int lenght = 1024;              //FFT lenght, samples per segment
+    int overlapPercent = 50;        //0, 50 or 75
+    WindowType window = WindowType::hann;
+    bool removeDc = false;          //subtract the mean of every segment
+    int batchSegments = 64;         //segments per batched plan
+    int threads = 1;                //0 uses every core
+    unsigned flags = FFTW_MEASURE;  //FFTW planner
+};
+
+/*averaged spectrum ready to plot: bins fftshift-ed, negative frequencies first*/
+struct Psd
+{
+    std::vector<double> freqMHz;    //absolute frequency of every bin
+    std::vector<double> dbfsPerHz;  //power spectral density relative to int8 full scale
+    double enbwHz = 0;              //equivalent noise bandwidth of one bin
+};
+
+/*
+Welch estimator: windowed segments of `lenght` samples every `hop` samples,
+|X|^2 of every segment summed over one or several threads.
+Segments are cut into batches at fixed multiples of batchSegments,
+every batch is summed on its own in float and the batch sums are added
+in double in batch order, so the result is bit-identical for any thread
+count (-j) as long as the stream is split into the same process() calls.
+A batch split across calls goes through the one-segment plan instead of
+the batched one, and FFTW may round those two differently */
+class SpectrumAverager
+{
+public:
+    explicit SpectrumAverager(const WelchSettings& settings);
+
+    /*next `count` samples of the stream, segments crossing calls are stitched*/
+    void process(const std::complex<int8_t>* samples, size_t count);
+
+    /*start a new average, plans and buffers are kept*/
+    void reset();
+
+    /*sum of |X|^2 over all segments so far, bins in FFT order*/
+    std::vector<double> powerSum() const;
+    long long segments() const { return segmentCount; }
+    int lenght() const { return N; }
+    int hop() const { return hopSize; }
+
+    /*
+    density scaled by the window's power sum, so ENBW is accounted for:
+    PSD = sum|X|^2 / (segments * sampleRate * sum(w^2)), in dB relative to 128^2 */
+    Psd psd(double centerFreq, double sampleRate) const;
+
+private:
+    /*`count` segments starting every hopSize samples from `base`*/
+    void runSegments(const std::complex<int8_t>* base, long long count);
+
+    int N;
+    int hopSize;
+    int batchSegments;
+    bool removeDc;
+    /*window duplicated for i and q, so it multiplies the interleaved buffer directly*/
+    std::vector<float> windowIQ;
+    double windowPowerSum = 0;
+    double windowSum = 0;
+
+    long long segmentCount = 0;
+    std::vector<double> sum;
+    /*batch that is not complete yet, continued by the next call*/
+    std::vector<float> openPartial;
+    /*samples from the next segment start to the end of the data seen so far*/
+    std::vector<std::complex<int8_t>> carry;
+    std::vector<std::complex<int8_t>> stitched;
+    std::vector<std::vector<float>> partials;
+    /*one engine with its own plans and buffers per worker*/
+    std::vector<std::unique_ptr<SpectrumEngine>> engines;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "sweep.h"
+
+/*a sweep retunes this many times at most, a typo in the step should not run for days*/
+constexpr size_t maxSweepSteps = 100000;
+
+static double parseHz(const std::string& text)
+{
+    try
+    {
+        size_t used = 0;
+        const double hz = std::stod(text, &used);
+        if(used == text.size() && std::isfinite(hz))
+        {
+            return hz;
+        }
+    }
+    catch(const std::exception&)
+    {
+    }
+    throw std::invalid_argument{"\"" + text + "\" is not a frequency"};
+}
+
+void checkSweepSpec(const std::string& spec)
+{
+    const bool list = spec.find(',') != std::string::npos || spec.find(':') == std::string::npos;
+    const char separator = list ? ',' : ':';
+    size_t parts = 0;
+    for(size_t start = 0; start <= spec.size(); parts++)
+    {
+        size_t end = spec.find(separator, start);
+        if(end == std::string::npos)
+        {
+            end = spec.size();
+        }
+        const double hz = parseHz(spec.substr(start, end - start));
+        if(!list && parts == 2 && hz <= 0)
+        {
+            throw std::invalid_argument{"The step of a sweep must be positive"};
+        }
+        start = end + 1;
+    }
+    if(!list && parts > 3)
+    {
+        throw std::invalid_argument{"\"" + spec + "\" is not START:STOP[:STEP]"};
+    }
+}
+
+SweepPlan sweepPlan(const std::string& spec, double sampleRate)
+{
+    SweepPlan plan;
+    const double usable = sampleRate * sweepUsableFraction;
+    if(spec.find(',') != std::string::npos || spec.find(':') == std::string::npos)
+    {
+        for(size_t start = 0; start <= spec.size();)
+        {
+            size_t end = spec.find(',', start);
+            if(end == std::string::npos)
+            {
+                end = spec.size();
+            }
+            plan.centers.push_back(parseHz(spec.substr(start, end - start)));
+            start = end + 1;
+        }
+        std::sort(plan.centers.begin(), plan.centers.end());
+        plan.centers.erase(std::unique(plan.centers.begin(), plan.centers.end()), plan.centers.end());
+        plan.lowHz = plan.centers.front() - usable / 2;
+        plan.highHz = plan.centers.back() + usable / 2;
+        return plan;
+    }
+
+    const size_t colon = spec.find(':');
+    const size_t second = spec.find(':', colon + 1);
+    plan.lowHz = parseHz(spec.substr(0, colon));
+    plan.highHz = parseHz(spec.substr(colon + 1, second == std::string::npos ? std::string::npos : second - colon - 1));
+    const double step = second == std::string::npos ? usable : parseHz(spec.substr(second + 1));
+    if(plan.highHz < plan.lowHz)
+    {
+        std::swap(plan.lowHz, plan.highHz);
+    }
+    if(step <= 0)
+    {
+        throw std::invalid_argument{"The step of a sweep must be positive"};
+    }
+    if((plan.highHz - plan.lowHz) / step + 1 > maxSweepSteps)
+    {
+        throw std::invalid_argument{"The sweep would take more than " + std::to_string(maxSweepSteps) + " steps"};
+    }
+    /*the first step's usable band starts at START, the last one reaches STOP. A step wider than the usable band leaves gaps*/
+    for(double center = plan.lowHz + std::min(step, usable) / 2; ; center += step)
+    {
+        plan.centers.push_back(center);
+        if(center + std::min(step, usable) / 2 >= plan.highHz)
+        {
+            break;
+        }
+    }
+    return plan;
+}
+
+SweepStitcher::SweepStitcher(const SweepPlan& plan, double sampleRate)
+    : plan(plan), pieces(plan.centers.size())
+{
+    const double half = sampleRate * sweepUsableFraction / 2;
+    const std::vector<double>& c = plan.centers;
+    for(size_t k = 0; k < c.size(); k++)
+    {
+        low.push_back(std::max({c[k] - half, plan.lowHz, k > 0 ? (c[k - 1] + c[k]) / 2 : plan.lowHz}));
+        high.push_back(std::min({c[k] + half, plan.highHz, k + 1 < c.size() ? (c[k] + c[k + 1]) / 2 : plan.highHz}));
+    }
+}
+
+void SweepStitcher::add(size_t step, const Psd& psd)
+{
+    Psd& piece = pieces.at(step);
+    piece.freqMHz.clear();
+    piece.dbfsPerHz.clear();
+    piece.enbwHz = psd.enbwHz;
+    for(size_t i = 0; i < psd.freqMHz.size(); i++)
+    {
+        /*half-open, so a bin on the border of two steps is only kept once*/
+        const double hz = psd.freqMHz[i] * 1e6;
+        if(hz >= low[step] && (hz < high[step] || (step + 1 == pieces.size() && hz == high[step])))
+        {
+            piece.freqMHz.push_back(psd.freqMHz[i]);
+            piece.dbfsPerHz.push_back(psd.dbfsPerHz[i]);
+        }
+    }
+}
+
+Psd SweepStitcher::result() const
+{
+    Psd wide;
+    for(const Psd& piece : pieces)
+    {
+        wide.freqMHz.insert(wide.freqMHz.end(), piece.freqMHz.begin(), piece.freqMHz.end());
+        wide.dbfsPerHz.insert(wide.dbfsPerHz.end(), piece.dbfsPerHz.begin(), piece.dbfsPerHz.end());
+        wide.enbwHz = std::max(wide.enbwHz, piece.enbwHz);
+    }
+    return wide;
+}
@@ -0,0 +1,49 @@
+#ifndef _SWEEP_H
+#define _SWEEP_H
+
+#include <string>
+#include <vector>
+#include "spectrum.h"
+
+/*
+part of every step's band that is kept, the anti-alias filter of the receiver
+rolls off the edges. Also the default step of a range as a fraction of the rate */
+constexpr double sweepUsableFraction = 0.8;
+
+/*center frequencies of a sweep and the span the stitched spectrum covers, Hz*/
+struct SweepPlan
+{
+    std::vector<double> centers;    //in ascending order
+    double lowHz = 0;
+    double highHz = 0;
+};
+
+/*
+-F: "START:STOP" or "START:STOP:STEP" covers START to STOP with steps of STEP
+(default the usable part of the band), "F1,F2,..." visits the listed centers */
+SweepPlan sweepPlan(const std::string& spec, double sampleRate);
+/*only the syntax of a -F spec, the number of steps depends on the sample rate. Throws std::invalid_argument*/
+void checkSweepSpec(const std::string& spec);
+
+/*
+wide-band spectrum out of the spectra of the steps. A step keeps the bins of the
+usable part of its band that are nearer its own center than any other, so
+overlapping steps do not repeat bins and the rolled-off edges are dropped */
+class SweepStitcher
+{
+public:
+    SweepStitcher(const SweepPlan& plan, double sampleRate);
+
+    /*spectrum of step `step`, steps may come in any order*/
+    void add(size_t step, const Psd& psd);
+    /*bins of every step added so far, in frequency order*/
+    Psd result() const;
+
+private:
+    SweepPlan plan;
+    std::vector<double> low;
+    std::vector<double> high;
+    std::vector<Psd> pieces;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include <cmath>
+#include <algorithm>
+#include "synthetic.h"
+
+/*entries of the Gaussian table, a power of 2 so an index is a masked random*/
+constexpr size_t gaussianTableSize = 1 << 16;
+/*tone phasors drift from unit lenght, they are renormalised this often*/
+constexpr size_t renormaliseEvery = 4096;
+
+SyntheticSignal::SyntheticSignal(const SyntheticSettings& settings)
+    : settings(settings), state(settings.seed * 0x9e3779b97f4a7c15ULL + 1)
+{
+    /*Box-Muller once, so the stream itself costs two table lookups per sample*/
+    gaussian.resize(gaussianTableSize);
+    for(size_t i = 0; i < gaussianTableSize; i += 2)
+    {
+        const double u1 = std::max(uniform(), 1e-300);
+        const double u2 = uniform();
+        const double r = std::sqrt(-2 * std::log(u1));
+        gaussian[i] = static_cast<float>(r * std::cos(2 * M_PI * u2));
+        gaussian[i + 1] = static_cast<float>(r * std::sin(2 * M_PI * u2));
+    }
+    for(double offset : settings.toneOffsetsHz)
+    {
+        tonePhasors.emplace_back(settings.toneAmplitude, 0);
+        toneRotations.push_back(std::polar(1.0, 2 * M_PI * offset / settings.sampleRate));
+    }
+    scheduleNextPing();
+}
+
+/*xorshift64*, fast and good enough for noise*/
+uint64_t SyntheticSignal::nextRandom()
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545f4914f6cdd1dULL;
+}
+
+double SyntheticSignal::uniform()
+{
+    return (nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+void SyntheticSignal::scheduleNextPing()
+{
+    if(settings.pingsPerSecond <= 0)
+    {
+        nextPing = -1;
+        return;
+    }
+    const double waitSeconds = -std::log(std::max(uniform(), 1e-300)) / settings.pingsPerSecond;
+    nextPing = samples + std::max(1LL, static_cast<long long>(waitSeconds * settings.sampleRate));
+}
+
+void SyntheticSignal::generate(std::complex<int8_t>* out, size_t count)
+{
+    const size_t mask = gaussianTableSize - 1;
+    const float noise = static_cast<float>(settings.noiseRms);
+    for(size_t n = 0; n < count; n++, samples++)
+    {
+        if(samples == nextPing)
+        {
+            /*an echo starts at full strength and fades, its Doppler shift is random*/
+            const double doppler = (2 * uniform() - 1) * settings.maxDopplerHz;
+            pingPhasor = std::polar(1.0, 2 * M_PI * uniform());
+            pingRotation = std::polar(1.0, 2 * M_PI * (settings.carrierOffsetHz + doppler) / settings.sampleRate);
+            pingLevel = settings.pingAmplitude;
+            pingDecay = std::exp(-1 / (settings.pingDecaySeconds * settings.sampleRate));
+            pingCount++;
+            scheduleNextPing();
+        }
+
+        const uint64_t r = nextRandom();
+        double i = noise * gaussian[r & mask];
+        double q = noise * gaussian[(r >> 16) & mask];
+        for(size_t t = 0; t < tonePhasors.size(); t++)
+        {
+            i += tonePhasors[t].real();
+            q += tonePhasors[t].imag();
+            tonePhasors[t] *= toneRotations[t];
+        }
+        if(pingLevel > 0.25)
+        {
+            i += pingLevel * pingPhasor.real();
+            q += pingLevel * pingPhasor.imag();
+            pingPhasor *= pingRotation;
+            pingLevel *= pingDecay;
+        }
+        out[n] = std::complex<int8_t>(static_cast<int8_t>(std::max(-128.0, std::min(127.0, std::round(i)))),
+                                      static_cast<int8_t>(std::max(-128.0, std::min(127.0, std::round(q)))));
+
+        if(samples % renormaliseEvery == 0)
+        {
+            for(std::complex<double>& phasor : tonePhasors)
+            {
+                if(settings.toneAmplitude > 0)
+                {
+                    phasor *= settings.toneAmplitude / std::abs(phasor);
+                }
+            }
+            if(pingLevel > 0.25)
+            {
+                pingPhasor /= std::abs(pingPhasor);
+            }
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef _SYNTHETIC_H
+#define _SYNTHETIC_H
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <cstddef>
+
+/*what the synthetic receiver hears, amplitudes in int8 counts*/
+struct SyntheticSettings
+{
+    double sampleRate = 250000;
+    std::vector<double> toneOffsetsHz = {-60000, 25000};   //from the center frequency
+    double toneAmplitude = 20;
+    double noiseRms = 6;                //per i and q
+    double carrierOffsetHz = 10000;     //radar carrier the meteor echoes are reflected from
+    double pingsPerSecond = 0.5;        //mean rate, arrivals are Poisson
+    double pingAmplitude = 60;          //at the start of an echo, it decays exponentially
+    double pingDecaySeconds = 0.1;
+    double maxDopplerHz = 300;          //every echo gets a Doppler shift up to this either way
+    uint64_t seed = 1;
+};
+
+/*
+endless CS8 stream of tones, Gaussian noise and meteor echoes. The same seed
+gives the same counts whatever the sizes of the generate() calls, so runs of a
+benchmark or a soak test can be compared sample for sample */
+class SyntheticSignal
+{
+public:
+    explicit SyntheticSignal(const SyntheticSettings& settings);
+
+    /*next `count` samples of the stream*/
+    void generate(std::complex<int8_t>* out, size_t count);
+    long long position() const { return samples; }
+    long long pings() const { return pingCount; }
+
+private:
+    uint64_t nextRandom();
+    double uniform();
+    void scheduleNextPing();
+
+    SyntheticSettings settings;
+    uint64_t state;
+    long long samples = 0;
+    /*Gaussian values with unit variance, picked by random indices*/
+    std::vector<float> gaussian;
+    std::vector<std::complex<double>> tonePhasors;
+    std::vector<std::complex<double>> toneRotations;
+    long long nextPing = 0;
+    long long pingCount = 0;
+    double pingLevel = 0;
+    double pingDecay = 1;
+    std::complex<double> pingPhasor;
+    std::complex<double> pingRotation;
+};
+
+#endif
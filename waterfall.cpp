@@ -0,0 +1,261 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <stdexcept>
+#include "waterfall.h"
+
+WaterfallFormat waterfallFormatFromName(const std::string& name)
+{
+    if(name == "uint8")
+    {
+        return WaterfallFormat::uint8;
+    }
+    if(name == "float16")
+    {
+        return WaterfallFormat::float16;
+    }
+    throw std::invalid_argument{"unknown waterfall format " + name + ", use uint8 or float16"};
+}
+
+size_t waterfallRowSize(const WaterfallHeader& header)
+{
+    const size_t valueSize = header.format == WaterfallFormat::float16 ? 2 : 1;
+    return sizeof(int64_t) + static_cast<size_t>(header.bins) * valueSize;
+}
+
+/*IEEE half precision, round to nearest even, enough for dB values*/
+static uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = (bits >> 16) & 0x8000;
+    const int exponent = static_cast<int>((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if(exponent >= 31)
+    {
+        /*too large (or inf / nan), saturate to inf*/
+        return sign | 0x7c00;
+    }
+    if(exponent <= 0)
+    {
+        /*subnormal or zero*/
+        if(exponent < -10)
+        {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        const int shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if(rest > halfway || (rest == halfway && (half & 1)))
+        {
+            half++;
+        }
+        return sign | half;
+    }
+    uint32_t half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+    const uint32_t rest = mantissa & 0x1fff;
+    if(rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+    {
+        /*carry may ripple into the exponent, which is still correct*/
+        half++;
+    }
+    return sign | half;
+}
+
+static float halfToFloat(uint16_t half)
+{
+    const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+    const int exponent = (half >> 10) & 0x1f;
+    const uint32_t mantissa = half & 0x3ff;
+    if(exponent == 0)
+    {
+        const float value = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -value : value;
+    }
+    uint32_t bits;
+    if(exponent == 31)
+    {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else
+    {
+        bits = sign | (static_cast<uint32_t>(exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void writeHeader(std::fstream& file, const WaterfallHeader& header)
+{
+    file.write(header.magic, sizeof(header.magic));
+    file.write(reinterpret_cast<const char*>(&header.version), sizeof(header.version));
+    file.write(reinterpret_cast<const char*>(&header.format), sizeof(header.format));
+    file.write(reinterpret_cast<const char*>(&header.bins), sizeof(header.bins));
+    file.write(reinterpret_cast<const char*>(&header.freq), sizeof(header.freq));
+    file.write(reinterpret_cast<const char*>(&header.sampleRate), sizeof(header.sampleRate));
+    file.write(reinterpret_cast<const char*>(&header.rowSeconds), sizeof(header.rowSeconds));
+    file.write(reinterpret_cast<const char*>(&header.dbMin), sizeof(header.dbMin));
+    file.write(reinterpret_cast<const char*>(&header.dbStep), sizeof(header.dbStep));
+}
+
+/*false when the stream does not start with a version 1 waterfall header*/
+static bool readHeader(std::istream& file, WaterfallHeader& header)
+{
+    file.read(header.magic, sizeof(header.magic));
+    file.read(reinterpret_cast<char*>(&header.version), sizeof(header.version));
+    file.read(reinterpret_cast<char*>(&header.format), sizeof(header.format));
+    file.read(reinterpret_cast<char*>(&header.bins), sizeof(header.bins));
+    file.read(reinterpret_cast<char*>(&header.freq), sizeof(header.freq));
+    file.read(reinterpret_cast<char*>(&header.sampleRate), sizeof(header.sampleRate));
+    file.read(reinterpret_cast<char*>(&header.rowSeconds), sizeof(header.rowSeconds));
+    file.read(reinterpret_cast<char*>(&header.dbMin), sizeof(header.dbMin));
+    file.read(reinterpret_cast<char*>(&header.dbStep), sizeof(header.dbStep));
+    return file && std::memcmp(header.magic, "WFAL", 4) == 0 && header.version == 1 && header.bins > 0 &&
+           (header.format == WaterfallFormat::uint8 || header.format == WaterfallFormat::float16);
+}
+
+WaterfallWriter::WaterfallWriter(const std::string& fileName, const WaterfallHeader& header)
+    : header(header), row(waterfallRowSize(header))
+{
+    std::ifstream existing(fileName, std::ios::binary | std::ios::ate);
+    const long long existingSize = existing.is_open() ? static_cast<long long>(existing.tellg()) : 0;
+    if(existingSize > 0)
+    {
+        existing.seekg(0);
+        WaterfallHeader old;
+        if(!readHeader(existing, old))
+        {
+            throw std::runtime_error{fileName + " exists and is not a waterfall file"};
+        }
+        if(old.format != header.format || old.bins != header.bins || old.freq != header.freq ||
+           old.sampleRate != header.sampleRate || old.rowSeconds != header.rowSeconds ||
+           (header.format == WaterfallFormat::uint8 && (old.dbMin != header.dbMin || old.dbStep != header.dbStep)))
+        {
+            throw std::runtime_error{fileName + " was made with other settings, cannot append to it"};
+        }
+        existing.close();
+
+        existingRows = (existingSize - static_cast<long long>(waterfallHeaderSize)) / static_cast<long long>(row.size());
+        const long long end = waterfallHeaderSize + existingRows * static_cast<long long>(row.size());
+        if(end != existingSize && truncate(fileName.c_str(), end) != 0)
+        {
+            throw std::runtime_error{"Cannot cut the unfinished row off " + fileName};
+        }
+        file.open(fileName, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(end);
+    }
+    else
+    {
+        existing.close();
+        file.open(fileName, std::ios::trunc | std::ios::binary | std::ios::out);
+        if(file.is_open())
+        {
+            writeHeader(file, header);
+        }
+    }
+    if(!file.is_open() || !file)
+    {
+        throw std::runtime_error{"Cannot write to " + fileName};
+    }
+}
+
+WaterfallWriter::~WaterfallWriter()
+{
+    close();
+}
+
+bool WaterfallWriter::append(long long timeNs, const std::vector<double>& db)
+{
+    if(writeFailed)
+    {
+        return false;
+    }
+    int64_t time64 = timeNs;
+    std::memcpy(row.data(), &time64, sizeof(time64));
+    char* values = row.data() + sizeof(time64);
+    const size_t bins = std::min(db.size(), static_cast<size_t>(header.bins));
+    if(header.format == WaterfallFormat::uint8)
+    {
+        for(size_t k = 0; k < bins; k++)
+        {
+            const double count = std::round((db[k] - header.dbMin) / header.dbStep);
+            values[k] = static_cast<char>(static_cast<uint8_t>(std::min(255.0, std::max(0.0, count))));
+        }
+    }
+    else
+    {
+        for(size_t k = 0; k < bins; k++)
+        {
+            const uint16_t half = floatToHalf(static_cast<float>(db[k]));
+            std::memcpy(values + 2 * k, &half, sizeof(half));
+        }
+    }
+    file.write(row.data(), row.size());
+    if(!file)
+    {
+        writeFailed = true;
+        return false;
+    }
+    written++;
+    return true;
+}
+
+void WaterfallWriter::close()
+{
+    if(file.is_open())
+    {
+        file.close();
+    }
+}
+
+WaterfallReader::WaterfallReader(const std::string& fileName)
+{
+    file.open(fileName, std::ios::binary | std::ios::ate);
+    if(!file.is_open())
+    {
+        throw std::runtime_error{"Cannot open the " + fileName + " Did you write its name correctly?"};
+    }
+    const long long size = file.tellg();
+    file.seekg(0);
+    if(!readHeader(file, hdr))
+    {
+        throw std::runtime_error{fileName + " is not a waterfall file"};
+    }
+    row.resize(waterfallRowSize(hdr));
+    rowCount = (size - static_cast<long long>(waterfallHeaderSize)) / static_cast<long long>(row.size());
+}
+
+bool WaterfallReader::next(long long& timeNs, std::vector<float>& db)
+{
+    if(!file.read(row.data(), row.size()))
+    {
+        return false;
+    }
+    int64_t time64;
+    std::memcpy(&time64, row.data(), sizeof(time64));
+    timeNs = time64;
+    db.resize(hdr.bins);
+    const char* values = row.data() + sizeof(time64);
+    if(hdr.format == WaterfallFormat::uint8)
+    {
+        for(int k = 0; k < hdr.bins; k++)
+        {
+            db[k] = hdr.dbMin + hdr.dbStep * static_cast<uint8_t>(values[k]);
+        }
+    }
+    else
+    {
+        for(int k = 0; k < hdr.bins; k++)
+        {
+            uint16_t half;
+            std::memcpy(&half, values + 2 * k, sizeof(half));
+            db[k] = halfToFloat(half);
+        }
+    }
+    return true;
+}
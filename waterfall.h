@@ -0,0 +1,91 @@
+#ifndef _WATERFALL_H
+#define _WATERFALL_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+
+/*how every dB value of a row is stored*/
+enum class WaterfallFormat : int32_t
+{
+    uint8 = 1,      //one byte, dbMin + count * dbStep
+    float16 = 2     //IEEE half precision dB value
+};
+/*translate -q argument (uint8, float16)*/
+WaterfallFormat waterfallFormatFromName(const std::string& name);
+
+/*
+spectrogram file (.wf): this header, then rows until the end of the file.
+Every row is int64 time_ns of its first block followed by `bins` dB values
+(dBFS/Hz, negative frequencies first like Psd). There is no row count,
+the file size tells it, so rows can be appended by any later run
+with the same settings. Native-endian, 48 bytes, no padding */
+struct WaterfallHeader
+{
+    char magic[4] = {'W', 'F', 'A', 'L'};
+    int32_t version = 1;
+    WaterfallFormat format = WaterfallFormat::uint8;
+    int32_t bins = 0;
+    double freq = 0;            //center frequency, Hz
+    double sampleRate = 0;
+    double rowSeconds = 0;      //stretch of the capture averaged into one row
+    float dbMin = -160;         //uint8 only: dB value of count 0
+    float dbStep = 0.625;       //uint8 only: dB per count, 0..255 covers -160..-0.6
+};
+constexpr size_t waterfallHeaderSize = 48;
+
+/*bytes of one row: time stamp plus the values*/
+size_t waterfallRowSize(const WaterfallHeader& header);
+
+/*
+appends rows to a .wf file. An existing file is continued when its header
+matches (format, bins, freq, sample rate and row time), otherwise it is an error,
+a half written row left by a crash is cut off first    */
+class WaterfallWriter
+{
+public:
+    WaterfallWriter(const std::string& fileName, const WaterfallHeader& header);
+    ~WaterfallWriter();
+    WaterfallWriter(const WaterfallWriter&) = delete;
+    WaterfallWriter& operator=(const WaterfallWriter&) = delete;
+
+    /*quantise `header.bins` dB values and append them as one row*/
+    bool append(long long timeNs, const std::vector<double>& db);
+    void close();
+
+    /*rows in the file before this writer started*/
+    long long rowsBefore() const { return existingRows; }
+    long long rowsWritten() const { return written; }
+    bool failed() const { return writeFailed; }
+
+private:
+    std::fstream file;
+    WaterfallHeader header;
+    std::vector<char> row;
+    long long existingRows = 0;
+    long long written = 0;
+    bool writeFailed = false;
+};
+
+/*reads a .wf file row by row, values come back as dB*/
+class WaterfallReader
+{
+public:
+    explicit WaterfallReader(const std::string& fileName);
+
+    const WaterfallHeader& header() const { return hdr; }
+    long long rows() const { return rowCount; }
+
+    /*next row in file order, false at the end*/
+    bool next(long long& timeNs, std::vector<float>& db);
+
+private:
+    std::ifstream file;
+    WaterfallHeader hdr;
+    std::vector<char> row;
+    long long rowCount = 0;
+};
+
+#endif